@@ -3,12 +3,25 @@
 #pragma warning( disable: 4365 )
 #include <type_traits>
 #include <cassert>
+#include <algorithm>
 #include <unordered_set>
 #include <queue>
 #include <stack>
 #include <vector>
 #include <tuple>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <span>
+#include <deque>
+#include <future>
+#include <cstdint>
+#include <array>
+#include <bit>
 #pragma warning( pop )
 
 // graph traversal
@@ -65,9 +78,233 @@ namespace trav
         const std::vector<T *> &data;
     };
 
+    // Lazily-started pool of worker threads shared by the graph algorithms.
+    // No threads are spawned until the first task is submitted, so touching the pool is cheap.
+    class thread_pool
+    {
+    public:
+        explicit thread_pool(
+            _In_ size_t num_workers = std::thread::hardware_concurrency( )
+            ) :
+            _num_workers(num_workers ? num_workers : 1)
+        { }
+
+        thread_pool(const thread_pool &) = delete;
+        thread_pool &operator=(const thread_pool &) = delete;
+
+        // Runs every task still in the queue before returning
+        ~thread_pool( )
+        {
+            {
+                std::lock_guard lock(_mutex);
+                _stopping = true;
+            }
+            _wake.notify_all( );
+            for (std::thread &worker : _workers)
+                worker.join( );
+        }
+
+        static thread_pool &shared( )
+        {
+            static thread_pool pool;
+            return pool;
+        }
+
+        size_t worker_count( ) const { return _num_workers; }
+
+        void submit(
+            _In_ std::function<void( )> task
+        )
+        {
+            {
+                std::lock_guard lock(_mutex);
+                if (_workers.empty( ))
+                {
+                    for (size_t i = 0; i < _num_workers; ++i)
+                        _workers.emplace_back(&thread_pool::_worker_loop, this);
+                }
+                _tasks.push(std::move(task));
+            }
+            _wake.notify_one( );
+        }
+
+        // Calls fn(begin, end) over chunks of [0, count) and blocks until all of them are done.
+        // The calling thread takes chunks too, so a busy pool only makes this slower, never stuck.
+        // If fn throws, the remaining chunks are skipped and the first exception is rethrown here
+        // once no thread is still inside fn.
+        template<class _Fn>
+        void parallel_for(
+            _In_ size_t count,
+            _In_ size_t min_grain,
+            _In_ _Fn fn
+        )
+        {
+            size_t num_chunks = std::min(count / std::max(min_grain, size_t(1)), _num_workers * 4);
+            if (num_chunks <= 1 || _num_workers <= 1)
+            {
+                if (count) fn(size_t(0), count);
+                return;
+            }
+
+            size_t chunk = (count + num_chunks - 1) / num_chunks;
+            num_chunks = (count + chunk - 1) / chunk;
+
+            struct chunk_state
+            {
+                std::atomic<size_t> next = 0, done = 0;
+                std::atomic<bool> failed = false;
+                std::exception_ptr error; // written only by the thread that set failed
+            };
+            auto state = std::make_shared<chunk_state>( );
+
+            // Helpers that start after every chunk is claimed never touch fn
+            auto run = [state, &fn, count, chunk, num_chunks]( )
+            {
+                for (size_t i; (i = state->next.fetch_add(1)) < num_chunks; )
+                {
+                    if (!state->failed.load( ))
+                    {
+                        try
+                        {
+                            size_t begin = i * chunk;
+                            fn(begin, std::min(begin + chunk, count));
+                        }
+                        catch (...)
+                        {
+                            if (!state->failed.exchange(true))
+                                state->error = std::current_exception( );
+                        }
+                    }
+
+                    if (state->done.fetch_add(1) + 1 == num_chunks)
+                        state->done.notify_all( );
+                }
+            };
+
+            size_t num_helpers = std::min(num_chunks, _num_workers) - 1;
+            for (size_t i = 0; i < num_helpers; ++i)
+                submit(run);
+            run( );
+
+            for (size_t done; (done = state->done.load( )) != num_chunks; )
+                state->done.wait(done);
+
+            if (state->error)
+                std::rethrow_exception(state->error);
+        }
+
+    private:
+        void _worker_loop( )
+        {
+            for (;;)
+            {
+                std::function<void( )> task;
+                {
+                    std::unique_lock lock(_mutex);
+                    _wake.wait(lock, [this]( ) { return _stopping || !_tasks.empty( ); });
+                    if (_tasks.empty( )) return;
+                    task = std::move(_tasks.front( ));
+                    _tasks.pop( );
+                }
+                task( );
+            }
+        }
+
+        size_t _num_workers;
+        bool _stopping = false;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::queue<std::function<void( )>> _tasks;
+        std::vector<std::thread> _workers;
+    };
+
+    // Weakly-connected components of a graph.
+    // id is indexed by vert::index( ); ids are dense and numbered by each component's lowest vertex.
+    struct components
+    {
+        std::vector<size_t> id;
+        std::vector<size_t> sizes;
+
+        size_t count( ) const { return sizes.size( ); }
+    };
+
+    // Vertex orderings for reorder( )
+    enum class vert_order
+    {
+        bfs,                   // breadth-first from each component's lowest index, ignoring direction
+        reverse_cuthill_mckee, // bandwidth-reducing; neighbours are visited lowest degree first
+        degree,                // highest total degree first
+    };
+
+    // Bytes held by a graph, not counting allocator overhead or memory owned by the payloads themselves
+    struct memory_report
+    {
+        size_t verts = 0;     // vert objects without payloads, the vert list and the topological order
+        size_t edges = 0;     // edge objects without payloads and the edge list
+        size_t adjacency = 0; // every vert's prev and next lists
+        size_t payloads = 0;  // vertex and edge data
+
+        size_t total( ) const { return verts + edges + adjacency + payloads; }
+    };
+
+    // Like deref_interface, but skips elements whose bit in mask is clear.
+    // Relies on each element's position in data being its index( ).
+    template<class T>
+    struct masked_deref_interface
+    {
+        masked_deref_interface(const std::vector<T *> &data, const std::vector<bool> &mask)
+            : data(data), mask(mask)
+        { }
+
+        struct const_masked_iter
+        {
+            const_masked_iter(const masked_deref_interface &owner, size_t pos)
+                : owner(owner), pos(pos)
+            {
+                skip( );
+            }
+
+                  T &operator*( )       { return *owner.data[pos]; }
+            const T &operator*( ) const { return *owner.data[pos]; }
+
+            bool operator!=(const const_masked_iter &other)
+            {
+                return pos != other.pos;
+            }
+
+            const_masked_iter &operator++()
+            {
+                ++pos;
+                skip( );
+                return *this;
+            }
+
+            void skip( )
+            {
+                while (pos < owner.data.size( ) && !owner.mask[pos])
+                    ++pos;
+            }
+
+            const masked_deref_interface &owner;
+            size_t pos;
+        };
+
+        const_masked_iter begin( ) const { return const_masked_iter(*this, 0); }
+        const_masked_iter end  ( ) const { return const_masked_iter(*this, data.size( )); }
+
+        const std::vector<T *> &data;
+        const std::vector<bool> &mask;
+    };
+
     template<class _VTy, class _ETy = void> class vert;
     template<class _VTy, class _ETy = void> class edge;
 
+    namespace
+    {
+        template<class _VTy, class _ETy = void> class _edge_base;
+        template<class _VTy, class _ETy = void> class _graph_base;
+    }
+
     template<class _VTy, class _ETy>
     class vert
     {
@@ -80,6 +317,12 @@ namespace trav
             _data(data)
         { }
 
+        vert(
+            _In_ _VTy &&data
+            ) :
+            _data(std::move(data))
+        { }
+
               std::vector<edge *> &prev( )       { return _prev; }
         const std::vector<edge *> &prev( ) const { return _prev; }
               std::vector<edge *> &next( )       { return _next; }
@@ -88,6 +331,9 @@ namespace trav
         size_t prev_count() const { return _prev.size(); }
         size_t next_count() const { return _next.size(); }
 
+        // Position in the owning graph's vertex list
+        size_t index( ) const { return _index; }
+
         bool bypassable( ) const
         {
             size_t numPrev = _prev.size( ), numNext = _next.size( );
@@ -98,13 +344,16 @@ namespace trav
         operator const _VTy &( ) const { return _data; }
 
     private:
+        template<class, class> friend class _graph_base;
+
         std::vector<edge *> _prev, _next;
+        size_t _index = 0;
         _VTy _data;
     };
 
     namespace
     {
-        template<class _VTy, class _ETy = void>
+        template<class _VTy, class _ETy>
         class _edge_base
         {
         public:
@@ -121,8 +370,14 @@ namespace trav
             vert &prev( ) const { return _prev; }
             vert &next( ) const { return _next; }
 
+            // Position in the owning graph's edge list
+            size_t index( ) const { return _index; }
+
         private:
+            template<class, class> friend class _graph_base;
+
             vert &_prev, &_next;
+            size_t _index = 0;
         };
     }
 
@@ -156,7 +411,7 @@ namespace trav
             _In_ _ETy data
             ) :
             base(prev, next),
-            _data(data)
+            _data(std::move(data))
         { }
 
         operator       _ETy &( )       { return _data; }
@@ -168,215 +423,944 @@ namespace trav
 
     namespace
     {
-        template<class _VTy, class _ETy = void>
+        template<class _VTy, class _ETy>
         class _graph_base
         {
         public:
             using vert = vert<_VTy, _ETy>;
             using edge = edge<_VTy, _ETy>;
 
-        private:
-            void _delete_verts( )
-            {
-                for (vert *v : verts)
-                    delete v;
-            };
-            void _delete_edges( )
-            {
-                for (edge *e : edges)
-                    delete e;
-            };
+            // Graphs with at least this many verts + edges are freed on the shared pool
+            static constexpr size_t deferred_release_min = 4096;
 
-        public:
-            ~_graph_base( )
-            {
-                constexpr size_t mtMinElements = 512, mtMinDifference = 256;
+            // Element count per task when cloning in parallel
+            static constexpr size_t clone_grain = 8192;
 
-                long long numVerts = verts.size( );
-                long long numEdges = edges.size( );
-                if ((numVerts + numEdges) > mtMinElements && abs(numVerts - numEdges) > mtMinDifference)
-                {
-                    std::thread vthread(&_graph_base::_delete_verts, this);
-                    _delete_edges( );
-                    vthread.join( );
-                }
-                else
-                {
-                    _delete_verts( );
-                    _delete_edges( );
-                }
-            }
+            // Element count per task when finding components in parallel
+            static constexpr size_t components_grain = 16384;
 
-            deref_interface<vert> all_verts( ) const { return deref_interface(verts); }
-            deref_interface<edge> all_edges( ) const { return deref_interface(edges); }
+            // Element count per task for the parallel find functions
+            static constexpr size_t scan_grain = 16384;
 
-            void push(
-                _In_ const _VTy &value
+            // Payloads handed to a batch predicate at a time
+            static constexpr size_t scan_batch = 1024;
+
+        private:
+            static edge *_copy_edge(
+                _In_ const edge &src,
+                _In_ vert &prev,
+                _In_ vert &next
             )
             {
-                verts.push_back(new vert(value));
+                if constexpr (std::is_void_v<_ETy>)
+                    return new edge(prev, next);
+                else
+                    return new edge(prev, next, static_cast<const _ETy &>(src));
             }
 
-            bool empty( )
+            static edge *_move_edge(
+                _Inout_ edge &src,
+                _In_ vert &prev,
+                _In_ vert &next
+            )
             {
-                return verts.empty( );
+                if constexpr (std::is_void_v<_ETy>)
+                    return new edge(prev, next);
+                else
+                    return new edge(prev, next, std::move(static_cast<_ETy &>(src)));
             }
 
-            vert &at(
-                _In_range_(<, verts.size()) size_t index
+            // Frees every vert and edge in the lists, handing large lists to the shared pool
+            // so that the caller doesn't pay for the destructors.
+            static void _release(
+                _Inout_ std::vector<vert *> &vs,
+                _Inout_ std::vector<edge *> &es,
+                _In_ bool keep_capacity
             )
             {
-                assert(index < verts.size( ));
-                return *verts.at(index);
-            }
+                if (vs.size( ) + es.size( ) < deferred_release_min)
+                {
+                    for (vert *v : vs)
+                        delete v;
+                    for (edge *e : es)
+                        delete e;
+                }
+                else
+                {
+                    std::vector<vert *> doomed_verts;
+                    std::vector<edge *> doomed_edges;
+                    if (keep_capacity)
+                    {
+                        doomed_verts = vs;
+                        doomed_edges = es;
+                    }
+                    else
+                    {
+                        doomed_verts.swap(vs);
+                        doomed_edges.swap(es);
+                    }
 
-            const vert &at(
-                _In_range_(<, verts.size( )) size_t index
-            ) const
-            {
-                assert(index < verts.size( ));
-                return *verts.at(index);
+                    thread_pool::shared( ).submit([vs = std::move(doomed_verts), es = std::move(doomed_edges)]( )
+                    {
+                        for (vert *v : vs)
+                            delete v;
+                        for (edge *e : es)
+                            delete e;
+                    });
+                }
+                vs.clear( );
+                es.clear( );
             }
 
         protected:
-            void _link(
-                _In_ vert &prev,
-                _In_ vert &next,
-                _In_ edge *e
+            void _renumber_verts(
+                _In_ size_t first
             )
             {
-                assert(&prev != &next);
-
-                edges.push_back(e);
-                prev.next( ).push_back(e);
-                next.prev( ).push_back(e);
+                for (size_t i = first; i < verts.size( ); ++i)
+                    verts[i]->_index = i;
             }
 
-        public:
-            edge &edge_at(
-                _In_range_(0, edge_count()) size_t index
+            void _renumber_edges(
+                _In_ size_t first
             )
             {
-                return *edges[index];
+                for (size_t i = first; i < edges.size( ); ++i)
+                    edges[i]->_index = i;
             }
 
-            const edge &edge_at(
-                _In_range_(0, edge_count()) size_t index
+            // Deep copies this graph into an empty graph, remapping pointers by index
+            void _clone_into(
+                _Inout_ _graph_base &dst
             ) const
             {
-                return *edges[index];
-            }
+                assert(dst.empty( ) && dst.edges.empty( ));
 
-            _Ret_maybenull_ edge *edge_between(
-                _In_ const vert &from_vert,
-                _In_ const vert &  to_vert
-            )
-            {
-                auto &from_vert_edges = from_vert.next( );
-                auto &  to_vert_edges =   to_vert.prev( );
+                const size_t num_verts = verts.size( );
+                const size_t num_edges = edges.size( );
+                dst.verts.resize(num_verts);
+                dst.edges.resize(num_edges);
 
-                if (from_vert_edges.size( ) < to_vert_edges.size( ))
+                thread_pool &pool = thread_pool::shared( );
+
+                pool.parallel_for(num_verts, clone_grain, [&](size_t begin, size_t end)
                 {
-                    // Look for 'to' in 'from'
-                    for (edge *e : from_vert_edges)
+                    for (size_t i = begin; i < end; ++i)
                     {
-                        if (&e->next( ) == &to_vert) return e;
+                        vert *v = new vert(static_cast<const _VTy &>(*verts[i]));
+                        v->_index = i;
+                        dst.verts[i] = v;
                     }
-                }
-                else
+                });
+
+                pool.parallel_for(num_edges, clone_grain, [&](size_t begin, size_t end)
                 {
-                    // Look for 'from' in 'to'
-                    for (edge *e : to_vert_edges)
+                    for (size_t i = begin; i < end; ++i)
                     {
-                        if (&e->prev( ) == &from_vert) return e;
+                        const edge &src = *edges[i];
+                        edge *e = _copy_edge(src, *dst.verts[src.prev( ).index( )], *dst.verts[src.next( ).index( )]);
+                        e->_index = i;
+                        dst.edges[i] = e;
                     }
-                }
+                });
 
-                return nullptr;
-            }
+                pool.parallel_for(num_verts, clone_grain, [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        const vert &src = *verts[i];
+                        vert &v = *dst.verts[i];
 
-            template<class _Func, class... _Args>
-            _Ret_maybenull_ vert *find(_In_ _Func fn, _Args... args)
-            {
-                for (vert *v : verts)
+                        v._prev.reserve(src._prev.size( ));
+                        for (const edge *e : src._prev)
+                            v._prev.push_back(dst.edges[e->index( )]);
+
+                        v._next.reserve(src._next.size( ));
+                        for (const edge *e : src._next)
+                            v._next.push_back(dst.edges[e->index( )]);
+                    }
+                });
+
+                if (topo.enabled)
                 {
-                    if (fn(*v, args...)) return v;
+                    dst.topo.enabled = true;
+                    dst.topo.pos = topo.pos;
+                    dst.topo.order.reserve(num_verts);
+                    for (const vert *v : topo.order)
+                        dst.topo.order.push_back(dst.verts[v->index( )]);
                 }
-                return nullptr;
             }
 
-            template<class _Func, class... _Args>
-            std::vector<vert *> find_all(_In_ _Func fn, _Args... args)
+            // Vertex indices in the requested order (new index -> old index)
+            std::vector<size_t> _ordering(
+                _In_ vert_order strategy
+            ) const
             {
-                std::vector<vert *> results;
-                for (vert *v : verts)
+                const size_t num_verts = verts.size( );
+                auto degree = [this](size_t i) { return verts[i]->prev_count( ) + verts[i]->next_count( ); };
+
+                std::vector<size_t> order;
+                order.reserve(num_verts);
+
+                if (strategy == vert_order::degree)
                 {
-                    if (fn(*v, args...)) results.push_back(v);
+                    for (size_t i = 0; i < num_verts; ++i)
+                        order.push_back(i);
+                    std::stable_sort(order.begin( ), order.end( ), [&degree](size_t a, size_t b) { return degree(a) > degree(b); });
+                    return order;
                 }
-                return results;
-            }
-
-            void unlink(
-                _Inout_ vert &from_vert,
-                _Inout_ vert &to_vert,
-                _Inout_ _Post_invalid_ edge &between_edge
-            )
-            {
-                auto &from = from_vert.next( );
-                auto &to = to_vert.prev( );
 
-                auto edgesEnd = edges.end( );
-                auto it_full = std::find(edges.begin( ), edgesEnd, &between_edge);
+                const bool rcm = strategy == vert_order::reverse_cuthill_mckee;
 
-                auto fromEnd = from.end( );
-                auto it_from = std::find(from.begin( ), fromEnd, &between_edge);
+                // RCM starts each component from its lowest-degree vertex
+                std::vector<size_t> starts;
+                starts.reserve(num_verts);
+                for (size_t i = 0; i < num_verts; ++i)
+                    starts.push_back(i);
+                if (rcm)
+                    std::stable_sort(starts.begin( ), starts.end( ), [&degree](size_t a, size_t b) { return degree(a) < degree(b); });
 
-                auto toEnd = to.end( );
-                auto it_to = std::find(to.begin( ), toEnd, &between_edge);
+                // order doubles as the BFS queue
+                std::vector<bool> visited(num_verts, false);
+                std::vector<size_t> neighbours;
+                for (size_t start : starts)
+                {
+                    if (visited[start]) continue;
+                    visited[start] = true;
+                    order.push_back(start);
 
-                assert(it_full != edgesEnd);
-                assert(it_from != fromEnd);
-                assert(it_to != toEnd);
+                    for (size_t head = order.size( ) - 1; head < order.size( ); ++head)
+                    {
+                        const vert &v = *verts[order[head]];
+                        neighbours.clear( );
+                        for (const edge *e : v.next( ))
+                            neighbours.push_back(e->next( ).index( ));
+                        for (const edge *e : v.prev( ))
+                            neighbours.push_back(e->prev( ).index( ));
+                        if (rcm)
+                            std::stable_sort(neighbours.begin( ), neighbours.end( ), [&degree](size_t a, size_t b) { return degree(a) < degree(b); });
+
+                        for (size_t w : neighbours)
+                        {
+                            if (!visited[w])
+                            {
+                                visited[w] = true;
+                                order.push_back(w);
+                            }
+                        }
+                    }
+                }
 
-                edges.erase(it_full);
-                from.erase(it_from);
-                to.erase(it_to);
-                delete &between_edge;
+                if (rcm)
+                    std::reverse(order.begin( ), order.end( ));
+                return order;
             }
 
-            void unlink(
-                _Inout_ vert &from_vert,
-                _Inout_ vert &  to_vert
+            // Rebuilds this graph into an empty graph with the verts in the given order, moving the payloads
+            // across so they aren't held twice; this graph is left with moved-from payloads, to be discarded.
+            // Everything is allocated serially in the new order so neighbours end up close in memory;
+            // edges are grouped by their (new) source vertex.
+            void _permute_into(
+                _Inout_ _graph_base &dst,
+                _In_ const std::vector<size_t> &new_to_old
             )
             {
-                edge *between = edge_between(from_vert, to_vert);
-                assert(between);
-                unlink(from_vert, to_vert, *between);
-            }
+                assert(dst.empty( ) && dst.edges.empty( ));
+                assert(new_to_old.size( ) == verts.size( ));
 
-            void erase(
-                _In_ _Post_invalid_ vert &erase_vert
-            )
-            {
-                // Erase reference from list of all verts
-                auto it = std::find(verts.begin( ), verts.end( ), &erase_vert);
-                assert(it != verts.end( )); // It SHOULD BE in the graph.
-                verts.erase(it);
+                const size_t num_verts = verts.size( );
+                dst.verts.reserve(num_verts);
+                dst.edges.reserve(edges.size( ));
 
-                // Erase references from inputs
-                for (edge *e : erase_vert.prev( ))
+                std::vector<size_t> old_to_new(num_verts);
+                for (size_t i = 0; i < num_verts; ++i)
                 {
-                    unlink(e->prev(), erase_vert, *e);
+                    old_to_new[new_to_old[i]] = i;
+                    vert *v = new vert(std::move(static_cast<_VTy &>(*verts[new_to_old[i]])));
+                    v->_index = i;
+                    dst.verts.push_back(v);
                 }
 
-                // Erase references from outputs
-                for (edge *e : erase_vert.next( ))
+                std::vector<edge *> old_to_new_edge(edges.size( ));
+                for (size_t i = 0; i < num_verts; ++i)
                 {
-                    unlink(erase_vert, e->next( ), *e);
+                    vert &v = *dst.verts[i];
+                    const vert &src = *verts[new_to_old[i]];
+                    v._next.reserve(src._next.size( ));
+                    for (edge *e : src._next)
+                    {
+                        edge *copy = _move_edge(*e, v, *dst.verts[old_to_new[e->next( ).index( )]]);
+                        copy->_index = dst.edges.size( );
+                        dst.edges.push_back(copy);
+                        v._next.push_back(copy);
+                        old_to_new_edge[e->index( )] = copy;
+                    }
                 }
 
-                // Free memory
-                delete &erase_vert;
+                for (size_t i = 0; i < num_verts; ++i)
+                {
+                    vert &v = *dst.verts[i];
+                    const vert &src = *verts[new_to_old[i]];
+                    v._prev.reserve(src._prev.size( ));
+                    for (const edge *e : src._prev)
+                        v._prev.push_back(old_to_new_edge[e->index( )]);
+                }
+
+                if (topo.enabled)
+                {
+                    dst.topo.enabled = true;
+                    dst.topo.pos.resize(num_verts);
+                    dst.topo.order.reserve(num_verts);
+                    for (size_t i = 0; i < num_verts; ++i)
+                        dst.topo.pos[i] = topo.pos[new_to_old[i]];
+                    for (const vert *v : topo.order)
+                        dst.topo.order.push_back(dst.verts[old_to_new[v->index( )]]);
+                }
+            }
+
+            // Collects the verts reachable from start (which must already be collected) whose
+            // topological position is strictly inside bound. Returns false if stop is reachable.
+            template<bool forward>
+            bool _topo_search(
+                _In_ vert &start,
+                _In_ size_t bound,
+                _Inout_ std::vector<vert *> &found,
+                _In_opt_ const vert *stop
+            )
+            {
+                topo.stack.clear( );
+                topo.stack.push_back(&start);
+                while (!topo.stack.empty( ))
+                {
+                    vert *v = topo.stack.back( );
+                    topo.stack.pop_back( );
+                    for (edge *e : forward ? v->_next : v->_prev)
+                    {
+                        vert &w = forward ? e->next( ) : e->prev( );
+                        if (&w == stop) return false;
+
+                        size_t pos = topo.pos[w.index( )];
+                        if (topo.marks[w.index( )] || (forward ? pos >= bound : pos <= bound)) continue;
+
+                        topo.marks[w.index( )] = true;
+                        found.push_back(&w);
+                        topo.stack.push_back(&w);
+                    }
+                }
+                return true;
+            }
+
+            // Pearce-Kelly: fixes up the order for a new edge prev -> next, only moving the
+            // verts ordered between next and prev. Returns false if the edge would close a cycle.
+            // see https://doi.org/10.1145/1187436.1210590
+            bool _topo_insert(
+                _In_ vert &prev,
+                _In_ vert &next
+            )
+            {
+                const size_t lower = topo.pos[next.index( )];
+                const size_t upper = topo.pos[prev.index( )];
+                if (upper < lower) return true;
+
+                if (topo.marks.size( ) < verts.size( ))
+                    topo.marks.resize(verts.size( ), false);
+
+                topo.forward.assign(1, &next);
+                topo.backward.assign(1, &prev);
+                topo.marks[next.index( )] = true;
+                topo.marks[prev.index( )] = true;
+
+                bool acyclic = _topo_search<true>(next, upper, topo.forward, &prev);
+                if (acyclic)
+                    _topo_search<false>(prev, lower, topo.backward, nullptr);
+
+                for (const vert *v : topo.forward)
+                    topo.marks[v->index( )] = false;
+                for (const vert *v : topo.backward)
+                    topo.marks[v->index( )] = false;
+
+                if (!acyclic) return false;
+
+                auto by_pos = [this](const vert *a, const vert *b) { return topo.pos[a->index( )] < topo.pos[b->index( )]; };
+                std::sort(topo.backward.begin( ), topo.backward.end( ), by_pos);
+                std::sort(topo.forward.begin( ), topo.forward.end( ), by_pos);
+
+                // Everything that reaches prev goes before everything next reaches, reusing their slots
+                topo.slots.clear( );
+                for (const vert *v : topo.backward)
+                    topo.slots.push_back(topo.pos[v->index( )]);
+                for (const vert *v : topo.forward)
+                    topo.slots.push_back(topo.pos[v->index( )]);
+                std::sort(topo.slots.begin( ), topo.slots.end( ));
+
+                size_t slot = 0;
+                for (std::vector<vert *> *region : { &topo.backward, &topo.forward })
+                {
+                    for (vert *v : *region)
+                    {
+                        topo.pos[v->index( )] = topo.slots[slot];
+                        topo.order[topo.slots[slot]] = v;
+                        ++slot;
+                    }
+                }
+                return true;
+            }
+
+        public:
+            _graph_base( )
+            {
+                // Make sure the pool outlives any graph that might defer its teardown to it
+                thread_pool::shared( );
+            }
+
+            // Copying would share verts and edges between graphs; use clone() instead
+            _graph_base(const _graph_base &) = delete;
+            _graph_base &operator=(const _graph_base &) = delete;
+
+            _graph_base(
+                _Inout_ _graph_base &&other
+                ) noexcept :
+                verts(std::move(other.verts)),
+                edges(std::move(other.edges)),
+                topo(std::move(other.topo))
+            {
+                other.verts.clear( );
+                other.edges.clear( );
+                other.topo = { };
+            }
+
+            _graph_base &operator=(
+                _Inout_ _graph_base &&other
+            ) noexcept
+            {
+                _graph_base discard(std::move(other));
+                swap(discard);
+                return *this;
+            }
+
+            ~_graph_base( )
+            {
+                _release(verts, edges, false);
+            }
+
+            void swap(
+                _Inout_ _graph_base &other
+            ) noexcept
+            {
+                verts.swap(other.verts);
+                edges.swap(other.edges);
+                std::swap(topo, other.topo);
+            }
+
+            // Destroys every vert and edge, keeping the capacity of the lists
+            void clear( )
+            {
+                _release(verts, edges, true);
+                topo.order.clear( );
+                topo.pos.clear( );
+            }
+
+            // Keeps a topological order up to date as verts are pushed and linked, so that links
+            // which would create a cycle are refused.
+            // Returns false, and stays disabled, if the graph already has a cycle.
+            bool enable_topological_order( )
+            {
+                const size_t num_verts = verts.size( );
+                std::vector<size_t> in_degree(num_verts);
+
+                // see https://en.wikipedia.org/wiki/Topological_sorting#Kahn's_algorithm
+                topo.order.clear( );
+                topo.order.reserve(num_verts);
+                for (size_t i = 0; i < num_verts; ++i)
+                {
+                    in_degree[i] = verts[i]->prev_count( );
+                    if (in_degree[i] == 0) topo.order.push_back(verts[i]);
+                }
+
+                for (size_t head = 0; head < topo.order.size( ); ++head)
+                {
+                    for (const edge *e : topo.order[head]->next( ))
+                    {
+                        size_t w = e->next( ).index( );
+                        if (--in_degree[w] == 0) topo.order.push_back(verts[w]);
+                    }
+                }
+
+                if (topo.order.size( ) != num_verts)
+                {
+                    topo = { };
+                    return false;
+                }
+
+                topo.pos.resize(num_verts);
+                for (size_t i = 0; i < num_verts; ++i)
+                    topo.pos[topo.order[i]->index( )] = i;
+                topo.enabled = true;
+                return true;
+            }
+
+            void disable_topological_order( )
+            {
+                topo = { };
+            }
+
+            bool maintains_topological_order( ) const { return topo.enabled; }
+
+            // Only meaningful while maintains_topological_order( )
+            const std::vector<vert *> &topological_order( ) const { return topo.order; }
+
+            // Position of v in topological_order( ); O(1)
+            size_t topological_index(
+                _In_ const vert &v
+            ) const
+            {
+                assert(topo.enabled);
+                return topo.pos[v.index( )];
+            }
+
+            // Relocates every vert and edge into the given order to improve traversal locality.
+            // Invalidates all references to the graph's verts and edges.
+            void reorder(
+                _In_ vert_order strategy
+            )
+            {
+                _graph_base reordered;
+                _permute_into(reordered, _ordering(strategy));
+                swap(reordered);
+            }
+
+            deref_interface<vert> all_verts( ) const { return deref_interface(verts); }
+            deref_interface<edge> all_edges( ) const { return deref_interface(edges); }
+
+            void push(
+                _In_ const _VTy &value
+            )
+            {
+                _push(new vert(value));
+            }
+
+            void push(
+                _In_ _VTy &&value
+            )
+            {
+                _push(new vert(std::move(value)));
+            }
+
+        private:
+            void _push(
+                _In_ vert *v
+            )
+            {
+                v->_index = verts.size( );
+                verts.push_back(v);
+
+                // A vert with no edges can go anywhere
+                if (topo.enabled)
+                {
+                    topo.pos.push_back(topo.order.size( ));
+                    topo.order.push_back(v);
+                }
+            }
+
+        public:
+
+            bool empty( )
+            {
+                return verts.empty( );
+            }
+
+            vert &at(
+                _In_range_(<, verts.size()) size_t index
+            )
+            {
+                assert(index < verts.size( ));
+                return *verts.at(index);
+            }
+
+            const vert &at(
+                _In_range_(<, verts.size( )) size_t index
+            ) const
+            {
+                assert(index < verts.size( ));
+                return *verts.at(index);
+            }
+
+        protected:
+            // Takes ownership of e; returns false and frees it if the link would break the topological order
+            bool _link(
+                _In_ vert &prev,
+                _In_ vert &next,
+                _In_ edge *e
+            )
+            {
+                assert(&prev != &next);
+
+                if (topo.enabled && !_topo_insert(prev, next))
+                {
+                    delete e;
+                    return false;
+                }
+
+                e->_index = edges.size( );
+                edges.push_back(e);
+                prev.next( ).push_back(e);
+                next.prev( ).push_back(e);
+                return true;
+            }
+
+        public:
+            edge &edge_at(
+                _In_range_(0, edge_count()) size_t index
+            )
+            {
+                return *edges[index];
+            }
+
+            const edge &edge_at(
+                _In_range_(0, edge_count()) size_t index
+            ) const
+            {
+                return *edges[index];
+            }
+
+            _Ret_maybenull_ edge *edge_between(
+                _In_ const vert &from_vert,
+                _In_ const vert &  to_vert
+            )
+            {
+                auto &from_vert_edges = from_vert.next( );
+                auto &  to_vert_edges =   to_vert.prev( );
+
+                if (from_vert_edges.size( ) < to_vert_edges.size( ))
+                {
+                    // Look for 'to' in 'from'
+                    for (edge *e : from_vert_edges)
+                    {
+                        if (&e->next( ) == &to_vert) return e;
+                    }
+                }
+                else
+                {
+                    // Look for 'from' in 'to'
+                    for (edge *e : to_vert_edges)
+                    {
+                        if (&e->prev( ) == &from_vert) return e;
+                    }
+                }
+
+                return nullptr;
+            }
+
+            template<class _Func, class... _Args>
+            _Ret_maybenull_ vert *find(_In_ _Func fn, _Args... args)
+            {
+                for (vert *v : verts)
+                {
+                    if (fn(*v, args...)) return v;
+                }
+                return nullptr;
+            }
+
+            template<class _Func, class... _Args>
+            std::vector<vert *> find_all(_In_ _Func fn, _Args... args)
+            {
+                std::vector<vert *> results;
+                for (vert *v : verts)
+                {
+                    if (fn(*v, args...)) results.push_back(v);
+                }
+                return results;
+            }
+
+            // The parallel finds below split verts across the shared pool,
+            // so fn must be safe to call from several threads at once.
+
+            // Same results as find_all, in the same order
+            template<class _Func, class... _Args>
+            std::vector<vert *> find_all_par(_In_ _Func fn, _Args... args)
+            {
+                std::mutex merge_mutex;
+                std::vector<std::pair<size_t, std::vector<vert *>>> chunks;
+
+                thread_pool::shared( ).parallel_for(verts.size( ), scan_grain, [&](size_t begin, size_t end)
+                {
+                    std::vector<vert *> chunk_results;
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        if (fn(*verts[i], args...)) chunk_results.push_back(verts[i]);
+                    }
+
+                    if (!chunk_results.empty( ))
+                    {
+                        std::lock_guard lock(merge_mutex);
+                        chunks.emplace_back(begin, std::move(chunk_results));
+                    }
+                });
+
+                return _merge_chunks(chunks);
+            }
+
+            template<class _Func, class... _Args>
+            size_t count_if(_In_ _Func fn, _Args... args)
+            {
+                std::atomic<size_t> count = 0;
+                thread_pool::shared( ).parallel_for(verts.size( ), scan_grain, [&](size_t begin, size_t end)
+                {
+                    size_t chunk_count = 0;
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        if (fn(*verts[i], args...)) ++chunk_count;
+                    }
+                    count.fetch_add(chunk_count, std::memory_order_relaxed);
+                });
+                return count.load( );
+            }
+
+            // Same result as find; tasks past the earliest match found so far stop early
+            template<class _Func, class... _Args>
+            _Ret_maybenull_ vert *find_first_par(_In_ _Func fn, _Args... args)
+            {
+                constexpr size_t cancel_check_interval = 1024;
+
+                std::atomic<size_t> first = verts.size( );
+                thread_pool::shared( ).parallel_for(verts.size( ), scan_grain, [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        if ((i - begin) % cancel_check_interval == 0 && i >= first.load(std::memory_order_relaxed))
+                            return;
+
+                        if (fn(*verts[i], args...))
+                        {
+                            size_t current = first.load(std::memory_order_relaxed);
+                            while (i < current && !first.compare_exchange_weak(current, i, std::memory_order_relaxed)) { }
+                            return;
+                        }
+                    }
+                });
+
+                size_t index = first.load( );
+                return index < verts.size( ) ? verts[index] : nullptr;
+            }
+
+            // Same results as find_all_par, but fn is called as fn(std::span<const _Key> block, std::span<bool> matches)
+            // with up to scan_batch keys at a time, where each key is proj(payload).
+            // Keys are gathered into a contiguous block per task so fn can be written as a vectorizable loop;
+            // they must be trivially copyable, so project large payloads down to the fields being tested.
+            template<class _Func, class _Proj = std::identity>
+            std::vector<vert *> find_all_batched(_In_ _Func fn, _In_ _Proj proj = { })
+            {
+                using _Key = std::remove_cvref_t<std::invoke_result_t<_Proj &, const _VTy &>>;
+                static_assert(std::is_trivially_copyable_v<_Key>, "find_all_batched gathers keys by copy; project to a trivially copyable key");
+
+                std::mutex merge_mutex;
+                std::vector<std::pair<size_t, std::vector<vert *>>> chunks;
+
+                thread_pool::shared( ).parallel_for(verts.size( ), scan_grain, [&](size_t begin, size_t end)
+                {
+                    std::vector<vert *> chunk_results;
+                    std::vector<_Key> block;
+                    block.reserve(std::min(scan_batch, end - begin));
+                    bool matches[scan_batch];
+
+                    for (size_t batch_begin = begin; batch_begin < end; batch_begin += scan_batch)
+                    {
+                        size_t batch_end = std::min(batch_begin + scan_batch, end);
+                        block.clear( );
+                        for (size_t i = batch_begin; i < batch_end; ++i)
+                            block.push_back(proj(static_cast<const _VTy &>(*verts[i])));
+
+                        std::fill_n(matches, block.size( ), false);
+                        fn(std::span<const _Key>(block), std::span<bool>(matches, block.size( )));
+
+                        for (size_t i = batch_begin; i < batch_end; ++i)
+                        {
+                            if (matches[i - batch_begin]) chunk_results.push_back(verts[i]);
+                        }
+                    }
+
+                    if (!chunk_results.empty( ))
+                    {
+                        std::lock_guard lock(merge_mutex);
+                        chunks.emplace_back(begin, std::move(chunk_results));
+                    }
+                });
+
+                return _merge_chunks(chunks);
+            }
+
+        private:
+            // Concatenates per-task results in vertex order
+            static std::vector<vert *> _merge_chunks(
+                _Inout_ std::vector<std::pair<size_t, std::vector<vert *>>> &chunks
+            )
+            {
+                std::sort(chunks.begin( ), chunks.end( ), [ ](const auto &a, const auto &b) { return a.first < b.first; });
+
+                size_t total = 0;
+                for (const auto &[begin, chunk] : chunks)
+                    total += chunk.size( );
+
+                std::vector<vert *> results;
+                results.reserve(total);
+                for (const auto &[begin, chunk] : chunks)
+                    results.insert(results.end( ), chunk.begin( ), chunk.end( ));
+                return results;
+            }
+
+        public:
+            // Weakly-connected components, using a lock-free union-find over the edge list.
+            // Roots are always hooked under the lower index, so each root is its component's lowest vertex.
+            components connected_components( ) const
+            {
+                const size_t num_verts = verts.size( );
+                std::unique_ptr<std::atomic<size_t>[ ]> parent(new std::atomic<size_t>[num_verts]);
+
+                // Finds the root of i, halving the path on the way up
+                auto find_root = [&parent](size_t i)
+                {
+                    for (;;)
+                    {
+                        size_t p = parent[i].load(std::memory_order_relaxed);
+                        if (p == i) return i;
+                        size_t gp = parent[p].load(std::memory_order_relaxed);
+                        if (gp != p) parent[i].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+                        i = gp;
+                    }
+                };
+
+                auto unite = [&parent, &find_root](size_t a, size_t b)
+                {
+                    for (;;)
+                    {
+                        a = find_root(a);
+                        b = find_root(b);
+                        if (a == b) return;
+                        if (a < b) std::swap(a, b);
+
+                        // Fails if another thread hooked a first; try again from the new roots
+                        size_t expected = a;
+                        if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) return;
+                    }
+                };
+
+                thread_pool &pool = thread_pool::shared( );
+
+                pool.parallel_for(num_verts, components_grain, [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; ++i)
+                        parent[i].store(i, std::memory_order_relaxed);
+                });
+
+                pool.parallel_for(edges.size( ), components_grain, [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; ++i)
+                        unite(edges[i]->prev( ).index( ), edges[i]->next( ).index( ));
+                });
+
+                components result;
+                result.id.resize(num_verts);
+
+                // Roots get their dense ids in index order...
+                for (size_t i = 0; i < num_verts; ++i)
+                {
+                    if (parent[i].load(std::memory_order_relaxed) == i)
+                    {
+                        result.id[i] = result.sizes.size( );
+                        result.sizes.push_back(0);
+                    }
+                }
+
+                // ...and every other vertex takes its root's id
+                pool.parallel_for(num_verts, components_grain, [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        size_t root = find_root(i);
+                        if (root != i) result.id[i] = result.id[root];
+                    }
+                });
+
+                for (size_t id : result.id)
+                    ++result.sizes[id];
+
+                return result;
+            }
+
+            void unlink(
+                _Inout_ vert &from_vert,
+                _Inout_ vert &to_vert,
+                _Inout_ _Post_invalid_ edge &between_edge
+            )
+            {
+                auto &from = from_vert.next( );
+                auto &to = to_vert.prev( );
+
+                size_t index_full = between_edge.index( );
+                assert(index_full < edges.size( ) && edges[index_full] == &between_edge);
+
+                auto fromEnd = from.end( );
+                auto it_from = std::find(from.begin( ), fromEnd, &between_edge);
+
+                auto toEnd = to.end( );
+                auto it_to = std::find(to.begin( ), toEnd, &between_edge);
+
+                assert(it_from != fromEnd);
+                assert(it_to != toEnd);
+
+                edges.erase(edges.begin( ) + index_full);
+                _renumber_edges(index_full);
+                from.erase(it_from);
+                to.erase(it_to);
+                delete &between_edge;
+            }
+
+            void unlink(
+                _Inout_ vert &from_vert,
+                _Inout_ vert &  to_vert
+            )
+            {
+                edge *between = edge_between(from_vert, to_vert);
+                assert(between);
+                unlink(from_vert, to_vert, *between);
+            }
+
+            void erase(
+                _In_ _Post_invalid_ vert &erase_vert
+            )
+            {
+                // Erase reference from list of all verts
+                size_t index = erase_vert.index( );
+                assert(index < verts.size( ) && verts[index] == &erase_vert); // It SHOULD BE in the graph.
+                verts.erase(verts.begin( ) + index);
+                _renumber_verts(index);
+
+                if (topo.enabled)
+                {
+                    size_t pos = topo.pos[index];
+                    topo.pos.erase(topo.pos.begin( ) + index);
+                    topo.order.erase(topo.order.begin( ) + pos);
+                    for (size_t i = pos; i < topo.order.size( ); ++i)
+                        topo.pos[topo.order[i]->index( )] = i;
+                }
+
+                // Erase references from inputs
+                // (unlink removes the edge from the list being walked, so always take the last one)
+                while (!erase_vert.prev( ).empty( ))
+                {
+                    edge *e = erase_vert.prev( ).back( );
+                    unlink(e->prev( ), erase_vert, *e);
+                }
+
+                // Erase references from outputs
+                while (!erase_vert.next( ).empty( ))
+                {
+                    edge *e = erase_vert.next( ).back( );
+                    unlink(erase_vert, e->next( ), *e);
+                }
+
+                // Free memory
+                delete &erase_vert;
             }
 
             template<std::integral T>
@@ -387,6 +1371,206 @@ namespace trav
                 erase(&at(static_cast<size_t>(erase_vert_index)));
             }
 
+            // Collects erases, unlinks and links and applies them together, so a large edit costs one
+            // compaction of the vert and edge lists instead of one per removal.
+            // Pushes still happen immediately so that the new verts can be linked in the same batch.
+            // Nothing else may change the graph while a batch is open; it commits when destroyed.
+            class batch
+            {
+            public:
+                explicit batch(
+                    _Inout_ _graph_base &g
+                    ) :
+                    _graph(g)
+                { }
+
+                batch(const batch &) = delete;
+                batch &operator=(const batch &) = delete;
+
+                ~batch( )
+                {
+                    commit( );
+                }
+
+                vert &push(
+                    _In_ const _VTy &value
+                )
+                {
+                    _graph.push(value);
+                    return *_graph.verts.back( );
+                }
+
+                // Also removes every edge to or from the vert
+                void erase(
+                    _In_ vert &erase_vert
+                )
+                {
+                    _mark(_dead_verts, erase_vert.index( ));
+                }
+
+                void unlink(
+                    _In_ edge &between_edge
+                )
+                {
+                    _mark(_dead_edges, between_edge.index( ));
+                }
+
+                // Takes a parallel edge not already unlinked in this batch, as repeated direct unlinks would
+                void unlink(
+                    _In_ vert &from_vert,
+                    _In_ vert &  to_vert
+                )
+                {
+                    edge *between = nullptr;
+                    for (edge *e : from_vert.next( ))
+                    {
+                        if (&e->next( ) == &to_vert && !_marked(_dead_edges, e->index( )))
+                        {
+                            between = e;
+                            break;
+                        }
+                    }
+                    assert(between);
+                    unlink(*between);
+                }
+
+                // Applied after the removals; links to verts erased in this batch are dropped
+                template<class... _Args>
+                void link(
+                    _In_ vert &prev,
+                    _In_ vert &next,
+                    _In_ const _Args &... value
+                )
+                {
+                    assert(&prev != &next);
+                    _links.push_back(new edge(prev, next, value...));
+                }
+
+                // Returns the number of links refused for breaking the topological order.
+                // Does nothing if nothing is queued, so committing early and then going out of scope is free.
+                size_t commit( )
+                {
+                    if (_dead_verts.empty( ) && _dead_edges.empty( ) && _links.empty( )) return 0;
+
+                    size_t refused = _graph._apply_batch(std::move(_dead_verts), std::move(_dead_edges), _links);
+                    _dead_verts.clear( );
+                    _dead_edges.clear( );
+                    _links.clear( );
+                    return refused;
+                }
+
+            private:
+                static void _mark(
+                    _Inout_ std::vector<bool> &marks,
+                    _In_ size_t index
+                )
+                {
+                    if (marks.size( ) <= index)
+                        marks.resize(index + 1, false);
+                    marks[index] = true;
+                }
+
+                static bool _marked(
+                    _In_ const std::vector<bool> &marks,
+                    _In_ size_t index
+                )
+                {
+                    return index < marks.size( ) && marks[index];
+                }
+
+                _graph_base &_graph;
+                std::vector<bool> _dead_verts, _dead_edges; // indexed by index( ) when marked
+                std::vector<edge *> _links;
+            };
+
+            batch begin_batch( )
+            {
+                return batch(*this);
+            }
+
+        protected:
+            // Removes the marked verts (with their edges) and edges in one pass over each list,
+            // renumbers and rebuilds the topological positions once, then adds the new links.
+            size_t _apply_batch(
+                _Inout_ std::vector<bool> &&dead_verts,
+                _Inout_ std::vector<bool> &&dead_edges,
+                _In_ const std::vector<edge *> &links
+            )
+            {
+                dead_verts.resize(verts.size( ), false);
+                dead_edges.resize(edges.size( ), false);
+
+                // Edges of erased verts go too
+                for (size_t i = 0; i < verts.size( ); ++i)
+                {
+                    if (!dead_verts[i]) continue;
+                    for (const edge *e : verts[i]->_prev)
+                        dead_edges[e->index( )] = true;
+                    for (const edge *e : verts[i]->_next)
+                        dead_edges[e->index( )] = true;
+                }
+
+                // Only the surviving ends of removed edges need their lists filtered
+                std::vector<bool> touched(verts.size( ), false);
+                for (size_t i = 0; i < edges.size( ); ++i)
+                {
+                    if (!dead_edges[i]) continue;
+                    touched[edges[i]->prev( ).index( )] = true;
+                    touched[edges[i]->next( ).index( )] = true;
+                }
+
+                auto is_dead_edge = [&dead_edges](const edge *e) { return dead_edges[e->index( )]; };
+                for (size_t i = 0; i < verts.size( ); ++i)
+                {
+                    if (!touched[i] || dead_verts[i]) continue;
+                    std::erase_if(verts[i]->_prev, is_dead_edge);
+                    std::erase_if(verts[i]->_next, is_dead_edge);
+                }
+
+                // Drop the links that would touch an erased vert while the old indices are still valid
+                std::vector<edge *> live_links;
+                live_links.reserve(links.size( ));
+                for (edge *e : links)
+                {
+                    if (dead_verts[e->prev( ).index( )] || dead_verts[e->next( ).index( )])
+                        delete e;
+                    else
+                        live_links.push_back(e);
+                }
+
+                if (topo.enabled)
+                    std::erase_if(topo.order, [&dead_verts](const vert *v) { return dead_verts[v->index( )]; });
+
+                std::erase_if(edges, [&dead_edges](edge *e)
+                {
+                    if (!dead_edges[e->index( )]) return false;
+                    delete e;
+                    return true;
+                });
+                std::erase_if(verts, [&dead_verts](vert *v)
+                {
+                    if (!dead_verts[v->index( )]) return false;
+                    delete v;
+                    return true;
+                });
+                _renumber_edges(0);
+                _renumber_verts(0);
+
+                if (topo.enabled)
+                {
+                    topo.pos.resize(verts.size( ));
+                    for (size_t i = 0; i < topo.order.size( ); ++i)
+                        topo.pos[topo.order[i]->index( )] = i;
+                }
+
+                size_t refused = 0;
+                for (edge *e : live_links)
+                {
+                    if (!_link(e->prev( ), e->next( ), e)) ++refused;
+                }
+                return refused;
+            }
+
         protected:
             // removes links but doesn't destroy the vertex
             template<class _Fn = decltype([ ](vert &, edge &, vert &, edge &, vert &){ })>
@@ -441,9 +1625,37 @@ namespace trav
             size_t vert_count() const { return verts.size(); }
             size_t edge_count() const { return edges.size(); }
 
+            memory_report memory_usage( ) const
+            {
+                constexpr size_t vert_payload = sizeof(_VTy);
+                constexpr size_t edge_payload = std::is_void_v<_ETy> ? 0 : sizeof(std::conditional_t<std::is_void_v<_ETy>, char, _ETy>);
+
+                memory_report report;
+                report.verts = verts.capacity( ) * sizeof(vert *) + verts.size( ) * (sizeof(vert) - vert_payload)
+                    + topo.order.capacity( ) * sizeof(vert *) + topo.pos.capacity( ) * sizeof(size_t);
+                report.edges = edges.capacity( ) * sizeof(edge *) + edges.size( ) * (sizeof(edge) - edge_payload);
+                report.payloads = verts.size( ) * vert_payload + edges.size( ) * edge_payload;
+                for (const vert *v : verts)
+                    report.adjacency += (v->prev( ).capacity( ) + v->next( ).capacity( )) * sizeof(edge *);
+                return report;
+            }
+
         protected:
+            struct _topological_state
+            {
+                bool enabled = false;
+                std::vector<vert *> order;
+                std::vector<size_t> pos; // indexed by vert::index( )
+
+                // Scratch for _topo_insert, kept to avoid reallocating on every link
+                std::vector<bool> marks;
+                std::vector<vert *> stack, forward, backward;
+                std::vector<size_t> slots;
+            };
+
             std::vector<vert *> verts;
             std::vector<edge *> edges;
+            _topological_state topo;
         };
     }
 
@@ -458,12 +1670,21 @@ namespace trav
         using vert = base::vert;
         using edge = base::edge;
 
-        void link(
+        // Returns false without linking if a topological order is maintained and this would create a cycle
+        bool link(
             _In_ vert &prev,
             _In_ vert &next
         )
         {
-            this->_link(prev, next, new edge(prev, next));
+            return this->_link(prev, next, new edge(prev, next));
+        }
+
+        // Deep copy; large graphs are copied in parallel on the shared pool
+        graph clone( ) const
+        {
+            graph result;
+            this->_clone_into(result);
+            return result;
         }
 
         // removes links but doesn't destroy the vertex
@@ -488,13 +1709,31 @@ namespace trav
         using vert = base::vert;
         using edge = base::edge;
 
-        void link(
+        // Returns false without linking if a topological order is maintained and this would create a cycle
+        bool link(
             _In_ vert &prev,
             _In_ vert &next,
             _In_ const _ETy &value
         )
         {
-            this->_link(prev, next, new edge(prev, next, value));
+            return this->_link(prev, next, new edge(prev, next, value));
+        }
+
+        bool link(
+            _In_ vert &prev,
+            _In_ vert &next,
+            _In_ _ETy &&value
+        )
+        {
+            return this->_link(prev, next, new edge(prev, next, std::move(value)));
+        }
+
+        // Deep copy; large graphs are copied in parallel on the shared pool
+        graph clone( ) const
+        {
+            graph result;
+            this->_clone_into(result);
+            return result;
         }
 
         struct bypass_combine_params
@@ -522,6 +1761,379 @@ namespace trav
         }
     };
 
+    // Immutable, compressed topology of a graph.
+    // Each vertex's neighbours are stored, in both directions, as their sorted vert::index( )es:
+    // a varint byte length followed by varint gaps between consecutive ids.
+    // Only every sample_interval'th vertex's position is stored; the ones between are found by
+    // hopping over the preceding lists by their lengths.
+    class compressed_adjacency
+    {
+    public:
+        enum class direction { forward, backward };
+
+        // Vertices per task when encoding in parallel
+        static constexpr size_t encode_grain = 16384;
+
+        // Vertices between stored positions; finding a vertex reads up to this many lengths
+        static constexpr size_t sample_interval = 64;
+
+        template<class _VTy, class _ETy>
+        explicit compressed_adjacency(
+            _In_ const _graph_base<_VTy, _ETy> &g
+            ) :
+            _num_verts(g.vert_count( ))
+        {
+            _encode(g, _forward, true);
+            _encode(g, _backward, false);
+        }
+
+        size_t vert_count( ) const { return _num_verts; }
+
+        size_t degree(
+            _In_range_(<, vert_count( )) size_t v,
+            _In_ direction dir
+        ) const
+        {
+            const uint8_t *it = _find(v, dir);
+            size_t length = _read_varint(it);
+
+            // Every varint ends in exactly one byte without the continuation bit
+            size_t count = 0;
+            for (const uint8_t *end = it + length; it != end; ++it)
+                count += !(*it & 0x80);
+            return count;
+        }
+
+        // Calls fn(size_t id) for every neighbour of v in ascending order, decoding as it goes
+        template<class _Fn>
+        void for_each_neighbour(
+            _In_range_(<, vert_count( )) size_t v,
+            _In_ direction dir,
+            _In_ _Fn fn
+        ) const
+        {
+            const uint8_t *it = _find(v, dir);
+            size_t length = _read_varint(it);
+            size_t id = 0;
+            for (const uint8_t *end = it + length; it != end; )
+            {
+                id += _read_varint(it);
+                fn(id);
+            }
+        }
+
+        size_t memory_usage( ) const
+        {
+            return (_forward.samples.capacity( ) + _backward.samples.capacity( )) * sizeof(uint64_t)
+                + _forward.bytes.capacity( ) + _backward.bytes.capacity( );
+        }
+
+        // see https://en.wikipedia.org/wiki/Breadth-first_search
+        // Returns vertex ids in the order they were reached
+        std::vector<size_t> bfs(
+            _In_ const std::vector<size_t> &roots,
+            _In_ direction dir
+        ) const
+        {
+            std::vector<bool> visited(_num_verts, false);
+            std::vector<size_t> order; // doubles as the queue
+            for (size_t root : roots)
+            {
+                assert(root < _num_verts);
+                if (visited[root]) continue;
+                visited[root] = true;
+                order.push_back(root);
+            }
+
+            for (size_t head = 0; head < order.size( ); ++head)
+            {
+                for_each_neighbour(order[head], dir, [&](size_t w)
+                {
+                    if (!visited[w])
+                    {
+                        visited[w] = true;
+                        order.push_back(w);
+                    }
+                });
+            }
+            return order;
+        }
+
+        // see https://en.wikipedia.org/wiki/Depth-first_search
+        // Returns vertex ids in the order they were discovered
+        std::vector<size_t> dfs(
+            _In_ const std::vector<size_t> &roots,
+            _In_ direction dir
+        ) const
+        {
+            std::vector<bool> visited(_num_verts, false);
+            std::vector<size_t> order, stack, neighbours;
+            for (size_t root : roots)
+            {
+                assert(root < _num_verts);
+                stack.push_back(root);
+                while (!stack.empty( ))
+                {
+                    size_t v = stack.back( );
+                    stack.pop_back( );
+                    if (visited[v]) continue;
+                    visited[v] = true;
+                    order.push_back(v);
+
+                    // Push in reverse so the lowest id is explored first
+                    neighbours.clear( );
+                    for_each_neighbour(v, dir, [&](size_t w) { if (!visited[w]) neighbours.push_back(w); });
+                    stack.insert(stack.end( ), neighbours.rbegin( ), neighbours.rend( ));
+                }
+            }
+            return order;
+        }
+
+    private:
+        struct encoded_lists
+        {
+            std::vector<uint64_t> samples; // into bytes, one per sample_interval vertices
+            std::vector<uint8_t> bytes;
+        };
+
+        // Start of v's list, at its length
+        const uint8_t *_find(
+            _In_range_(<, vert_count( )) size_t v,
+            _In_ direction dir
+        ) const
+        {
+            assert(v < _num_verts);
+            const encoded_lists &lists = dir == direction::forward ? _forward : _backward;
+
+            const uint8_t *it = lists.bytes.data( ) + lists.samples[v / sample_interval];
+            for (size_t skip = v % sample_interval; skip; --skip)
+            {
+                size_t length = _read_varint(it);
+                it += length;
+            }
+            return it;
+        }
+
+        static void _write_varint(
+            _Inout_ std::vector<uint8_t> &bytes,
+            _In_ size_t value
+        )
+        {
+            while (value >= 0x80)
+            {
+                bytes.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            bytes.push_back(static_cast<uint8_t>(value));
+        }
+
+        static size_t _read_varint(
+            _Inout_ const uint8_t *&it
+        )
+        {
+            size_t value = 0;
+            for (unsigned shift = 0; ; shift += 7)
+            {
+                uint8_t byte = *it++;
+                value |= size_t(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) return value;
+            }
+        }
+
+        // Encodes chunks of vertices in parallel, then stitches the chunks together in order
+        template<class _VTy, class _ETy>
+        static void _encode(
+            _In_ const _graph_base<_VTy, _ETy> &g,
+            _Out_ encoded_lists &lists,
+            _In_ bool forward
+        )
+        {
+            struct chunk
+            {
+                size_t begin;
+                std::vector<uint64_t> samples; // relative to this chunk's bytes
+                std::vector<uint8_t> bytes;
+            };
+
+            std::mutex merge_mutex;
+            std::vector<chunk> chunks;
+
+            thread_pool::shared( ).parallel_for(g.vert_count( ), encode_grain, [&](size_t begin, size_t end)
+            {
+                chunk c{ begin };
+                std::vector<size_t> ids;
+                std::vector<uint8_t> gaps;
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const auto &v = g.at(i);
+                    ids.clear( );
+                    if (forward)
+                    {
+                        for (const auto *e : v.next( ))
+                            ids.push_back(e->next( ).index( ));
+                    }
+                    else
+                    {
+                        for (const auto *e : v.prev( ))
+                            ids.push_back(e->prev( ).index( ));
+                    }
+                    std::sort(ids.begin( ), ids.end( ));
+
+                    gaps.clear( );
+                    size_t last = 0;
+                    for (size_t id : ids)
+                    {
+                        _write_varint(gaps, id - last);
+                        last = id;
+                    }
+
+                    if (i % sample_interval == 0)
+                        c.samples.push_back(c.bytes.size( ));
+                    _write_varint(c.bytes, gaps.size( ));
+                    c.bytes.insert(c.bytes.end( ), gaps.begin( ), gaps.end( ));
+                }
+
+                std::lock_guard lock(merge_mutex);
+                chunks.push_back(std::move(c));
+            });
+
+            std::sort(chunks.begin( ), chunks.end( ), [ ](const chunk &a, const chunk &b) { return a.begin < b.begin; });
+
+            size_t total_bytes = 0;
+            for (const chunk &c : chunks)
+                total_bytes += c.bytes.size( );
+
+            lists.samples.clear( );
+            lists.bytes.clear( );
+            lists.samples.reserve((g.vert_count( ) + sample_interval - 1) / sample_interval);
+            lists.bytes.reserve(total_bytes);
+            for (const chunk &c : chunks)
+            {
+                uint64_t base = lists.bytes.size( );
+                for (uint64_t sample : c.samples)
+                    lists.samples.push_back(base + sample);
+                lists.bytes.insert(lists.bytes.end( ), c.bytes.begin( ), c.bytes.end( ));
+            }
+        }
+
+        size_t _num_verts;
+        encoded_lists _forward, _backward;
+    };
+
+    // A selection of a graph's verts and edges, kept as masks over the parent so nothing is copied.
+    // Views built from verts are induced: they hold every edge between two selected verts.
+    // The parent must outlive the view, and any change to the parent invalidates it.
+    // Steppers are static, so a view can't be one; walks take filter( ) as their include predicate instead.
+    // connected_components( ) and compressed_adjacency always see the whole parent.
+    template<class _VTy, class _ETy>
+    class subgraph_view
+    {
+    public:
+        using vert = vert<_VTy, _ETy>;
+        using edge = edge<_VTy, _ETy>;
+        using graph_type = _graph_base<_VTy, _ETy>;
+
+        // The whole graph
+        explicit subgraph_view(
+            _In_ const graph_type &g
+            ) :
+            _parent(g),
+            _vert_mask(g.vert_count( ), true),
+            _edge_mask(g.edge_count( ), true),
+            _num_verts(g.vert_count( )),
+            _num_edges(g.edge_count( ))
+        { }
+
+        // Induced by a selection of verts, such as the result of find_all
+        subgraph_view(
+            _In_ const graph_type &g,
+            _In_ const std::vector<vert *> &selection
+            ) :
+            _parent(g),
+            _vert_mask(g.vert_count( ), false),
+            _edge_mask(g.edge_count( ), false)
+        {
+            for (const vert *v : selection)
+            {
+                assert(&g.at(v->index( )) == v);
+                _vert_mask[v->index( )] = true;
+            }
+            _induce( );
+        }
+
+        // Induced by one of the components from connected_components( )
+        subgraph_view(
+            _In_ const graph_type &g,
+            _In_ const components &c,
+            _In_ size_t component_id
+            ) :
+            _parent(g),
+            _vert_mask(g.vert_count( ), false),
+            _edge_mask(g.edge_count( ), false)
+        {
+            assert(c.id.size( ) == g.vert_count( ));
+            for (size_t i = 0; i < c.id.size( ); ++i)
+                _vert_mask[i] = c.id[i] == component_id;
+            _induce( );
+        }
+
+        // Drops the edges for which fn(edge) is false, such as everything outside one colour class.
+        // The verts are kept even if that leaves them isolated.
+        template<class _Func>
+        void keep_edges_if(
+            _In_ _Func fn
+        )
+        {
+            for (const edge &e : all_edges( ))
+            {
+                if (!fn(e))
+                {
+                    _edge_mask[e.index( )] = false;
+                    --_num_edges;
+                }
+            }
+        }
+
+        const graph_type &parent( ) const { return _parent; }
+
+        bool contains(_In_ const vert &v) const { return _vert_mask[v.index( )]; }
+        bool contains(_In_ const edge &e) const { return _edge_mask[e.index( )]; }
+
+        // Include predicate for walk: true for a step along an edge in the view to a vert in the view
+        auto filter( ) const
+        {
+            return [this](const edge &e, const vert &w) { return contains(e) && contains(w); };
+        }
+
+        size_t vert_count( ) const { return _num_verts; }
+        size_t edge_count( ) const { return _num_edges; }
+
+        masked_deref_interface<vert> all_verts( ) const { return masked_deref_interface(_parent.all_verts( ).data, _vert_mask); }
+        masked_deref_interface<edge> all_edges( ) const { return masked_deref_interface(_parent.all_edges( ).data, _edge_mask); }
+
+    private:
+        // Selects every edge whose ends are both selected
+        void _induce( )
+        {
+            _num_verts = 0;
+            _num_edges = 0;
+            for (bool selected : _vert_mask)
+                _num_verts += selected;
+            for (const edge &e : _parent.all_edges( ))
+            {
+                if (_vert_mask[e.prev( ).index( )] && _vert_mask[e.next( ).index( )])
+                {
+                    _edge_mask[e.index( )] = true;
+                    ++_num_edges;
+                }
+            }
+        }
+
+        const graph_type &_parent;
+        std::vector<bool> _vert_mask, _edge_mask;
+        size_t _num_verts = 0, _num_edges = 0;
+    };
+
     // ---
 
     template<class T>
@@ -556,17 +2168,66 @@ namespace trav
         using vert = vert<_VTy, _ETy>;
         using edge = edge<_VTy, _ETy>;
 
-        static const std::vector<edge *> &step(_In_ const vert &v)
+        static const std::vector<edge *> &step(_In_ const vert &v)
+        {
+            return v.prev( );
+        }
+
+        static vert &step(_In_ const edge &e)
+        {
+            return e.prev( );
+        }
+
+        static_assert(stepper_class<step_backward>);
+    };
+
+    // Optional bounds for the breadth-first walks
+    struct walk_limits
+    {
+        size_t max_depth = SIZE_MAX; // roots are depth 0
+        size_t max_steps = SIZE_MAX; // including the roots
+    };
+
+    // Scratch space for walk, kept between traversals so hot loops don't allocate.
+    // Visited marks are indexed by vert::index( ) and cleared in O(1) by bumping an epoch.
+    template<class _VTy, class _ETy>
+    struct walk_context
+    {
+        using vert = vert<_VTy, _ETy>;
+        using edge = edge<_VTy, _ETy>;
+
+        // Starts a new traversal; forgets every visited mark
+        void reset( )
         {
-            return v.prev( );
+            queue.clear( );
+            stack.clear( );
+            if (++epoch == 0)
+            {
+                std::fill(marks.begin( ), marks.end( ), 0);
+                epoch = 1;
+            }
         }
 
-        static vert &step(_In_ const edge &e)
+        bool visited(_In_ const vert &v) const
         {
-            return e.prev( );
+            return v.index( ) < marks.size( ) && marks[v.index( )] == epoch;
         }
 
-        static_assert(stepper_class<step_backward>);
+        // Marks v; returns false if it was already marked
+        bool visit(_In_ const vert &v)
+        {
+            size_t i = v.index( );
+            if (i >= marks.size( ))
+                marks.resize(std::max(i + 1, marks.size( ) * 2), 0);
+            if (marks[i] == epoch) return false;
+            marks[i] = epoch;
+            return true;
+        }
+
+        std::vector<uint32_t> marks;
+        uint32_t epoch = 0;
+        std::vector<const vert *> queue;
+        std::vector<std::tuple<edge *, const vert *>> stack;
     };
 
     template<class _VTy, class _ETy>
@@ -582,76 +2243,209 @@ namespace trav
 
         using walk_func = step_vector(walk:: *)(_In_ const std::vector<const vert *> &);
 
+        using context = walk_context<_VTy, _ETy>;
+
+        // Default include predicate: takes every step
+        struct include_all
+        {
+            constexpr bool operator( )(const edge &, const vert &) const { return true; }
+        };
+
+    private:
+        // Appends to out, which is cleared first but keeps its capacity
+        static auto _append_to(_Inout_ step_vector &out)
+        {
+            out.clear( );
+            return [&out](edge *e, vert *v) { out.emplace_back(e, v); };
+        }
+
         // see https://en.wikipedia.org/wiki/Breadth-first_search
         // 1  procedure BFS(G, root) is
-        template<stepper_class stepper>
-        static step_vector bfs(_In_ const std::vector<const vert *> &roots)
+        // Only steps for which include(edge, vert) is true are taken; visit(edge *, vert *) is called for each.
+        // Stops after limits.max_steps steps and doesn't step past limits.max_depth.
+        template<stepper_class stepper, class _Filter, class _Visit>
+        static void _bfs(_Inout_ context &ctx, _In_ const std::vector<const vert *> &roots, _In_ _Filter include, _In_ _Visit visit,
+                         _In_ const walk_limits &limits = { })
         {
-            step_vector result;
-            std::unordered_set<const vert *> visited;
+            ctx.reset( );
+            size_t steps = 0;
 
             // 2  let Q be a queue
-            std::queue<const vert *> q;
+            auto &q = ctx.queue;
 
             for (const vert *root : roots)
             {
+                if (steps == limits.max_steps) return;
+
                 // 3  label root as explored
-                visited.insert(root);
+                if (!ctx.visit(*root)) continue;
 
                 // 4  Q.enqueue(root)
-                q.push(root);
-                result.emplace_back(nullptr, root);
+                q.push_back(root);
+                visit(nullptr, const_cast<vert *>(root));
+                ++steps;
             }
 
+            // The queue holds whole levels in order, so depth goes up each time head passes the end of one
+            size_t depth = 0, level_end = q.size( );
+
             // 5  while Q is not empty do
-            while (!q.empty( ))
+            for (size_t head = 0; head < q.size( ); ++head)
             {
+                if (head == level_end)
+                {
+                    ++depth;
+                    level_end = q.size( );
+                }
+                if (depth >= limits.max_depth) return;
+
                 // 6  v := Q.dequeue()
-                const vert *v = q.front( );
-                q.pop( );
+                const vert *v = q[head];
 
                 // 9  for all edges from v to w in G.adjacentEdges(v) do
-                for (const edge *e : stepper::step(*v))
+                for (edge *e : stepper::step(*v))
                 {
-                    const vert &w = stepper::step(*e);
+                    vert &w = stepper::step(*e);
 
                     // 10  if w is not labeled as explored then
-                    if (!visited.contains(&w))
+                    if (!ctx.visited(w) && include(*e, w))
                     {
+                        if (steps == limits.max_steps) return;
+
                         // 11  label w as explored
-                        visited.insert(w);
+                        ctx.visit(w);
+                        ++steps;
 
                         // 13  Q.enqueue(w)
-                        q.push(w);
-                        result.emplace_back(e, &w);
+                        q.push_back(&w);
+                        visit(e, &w);
                     }
                 }
             }
+        }
 
+    public:
+        template<stepper_class stepper>
+        static step_vector bfs(_In_ const std::vector<const vert *> &roots)
+        {
+            step_vector result;
+            context ctx;
+            _bfs<stepper>(ctx, roots, include_all{ }, _append_to(result));
             return result;
         }
 
         static constexpr auto bfs_f = &bfs<forward>;
         static constexpr auto bfs_r = &bfs<backward>;
 
+        // Allocation-free once ctx and out have grown to fit.
+        // Only steps for which include(edge, vert) is true are taken, such as subgraph_view::filter( ); roots are always taken.
+        template<stepper_class stepper, class _Filter = include_all>
+        static void bfs_into(_Inout_ context &ctx, _In_ const std::vector<const vert *> &roots, _Outref_ step_vector &out,
+                             _In_ _Filter include = { }, _In_ const walk_limits &limits = { })
+        {
+            _bfs<stepper>(ctx, roots, include, _append_to(out), limits);
+        }
+
+        // visit(edge *, vert *) is called for every step instead of storing it; the edge is null for roots
+        template<stepper_class stepper, class _Visit, class _Filter = include_all>
+        static void bfs_each(_Inout_ context &ctx, _In_ const std::vector<const vert *> &roots, _In_ _Visit visit,
+                             _In_ _Filter include = { }, _In_ const walk_limits &limits = { })
+        {
+            _bfs<stepper>(ctx, roots, include, visit, limits);
+        }
+
+        // Breadth-first without leaving the view; the roots must be in the view
+        template<stepper_class stepper>
+        static step_vector bfs_within(_In_ const subgraph_view<_VTy, _ETy> &view, _In_ const std::vector<const vert *> &roots)
+        {
+            for (const vert *root : roots)
+                assert(view.contains(*root));
+
+            step_vector result;
+            context ctx;
+            _bfs<stepper>(ctx, roots, view.filter( ), _append_to(result));
+            return result;
+        }
+
+        static constexpr auto bfs_within_f = &bfs_within<forward>;
+        static constexpr auto bfs_within_r = &bfs_within<backward>;
+
     private:
         // 1  procedure DFS(G, v) is
-        template<stepper_class stepper>
-        static step_vector _dfs_util(_Inout_ std::unordered_set<const vert *> &visited, _In_ const vert *v)
+        template<stepper_class stepper, class _Filter, class _Visit>
+        static void _dfs_util(_Inout_ context &ctx, _In_opt_ edge *from, _In_ const vert &v, _In_ _Filter &include, _In_ _Visit &visit)
         {
             // 2  label v as discovered
-            visited.insert(v);
+            ctx.visit(v);
+            visit(from, const_cast<vert *>(&v));
 
             // 3  for all directed edges from v to w that are in G.adjacentEdges(v) do
             for (edge *e : stepper::step(v))
             {
-                const vert &w = stepper::step(e);
+                const vert &w = stepper::step(*e);
 
                 // 4  if vertex w is not labeled as discovered then
-                if (visited.contains(v))
+                if (!ctx.visited(w) && include(*e, w))
                 {
                     // 5  recursively call DFS(G, w)
-                    _dfs_util(visited, w);
+                    _dfs_util<stepper>(ctx, e, w, include, visit);
+                }
+            }
+        }
+
+        // Only steps for which include(edge, vert) is true are taken
+        template<stepper_class stepper, class _Filter, class _Visit>
+        static void _dfs(_Inout_ context &ctx, _In_ const std::vector<const vert *> &roots, _In_ _Filter include, _In_ _Visit visit)
+        {
+            ctx.reset( );
+            for (const vert *root : roots)
+            {
+                if (!ctx.visited(*root))
+                    _dfs_util<stepper>(ctx, nullptr, *root, include, visit);
+            }
+        }
+
+        // see https://en.wikipedia.org/wiki/Depth-first_search
+        // 1  procedure DFS_iterative(G, v) is
+        template<stepper_class stepper, class _Filter, class _Visit>
+        static void _dfs_stack(_Inout_ context &ctx, _In_ const std::vector<const vert *> &roots, _In_ _Filter include, _In_ _Visit visit)
+        {
+            ctx.reset( );
+
+            // 2  let S be a stack
+            auto &s = ctx.stack;
+            s.clear( );
+
+            // 3  S.push(v)
+            // (pushed in reverse so the first root is popped first)
+            for (auto it = roots.rbegin( ); it != roots.rend( ); ++it)
+                s.emplace_back(nullptr, *it);
+
+            // 4  while S is not empty do
+            while (!s.empty( ))
+            {
+                // 5  v = S.pop( )
+                auto [from, v] = s.back( );
+                s.pop_back( );
+
+                // 6  if v is not labeled as discovered then
+                // 7  label v as discovered
+                if (ctx.visit(*v))
+                {
+                    visit(from, const_cast<vert *>(v));
+
+                    // 8  for all edges from v to w in G.adjacentEdges(v) do
+                    // (pushed in reverse so the first edge is popped first, as in the recursive dfs)
+                    const auto &adjacent = stepper::step(*v);
+                    for (auto it = adjacent.rbegin( ); it != adjacent.rend( ); ++it)
+                    {
+                        edge *e = *it;
+                        vert &w = stepper::step(*e);
+
+                        // 9  S.push(w)
+                        if (include(*e, w))
+                            s.emplace_back(e, &w);
+                    }
                 }
             }
         }
@@ -662,38 +2456,491 @@ namespace trav
         static step_vector dfs(_In_ const std::vector<const vert *> &roots)
         {
             step_vector result;
-            std::unordered_set<const vert *> visited;
-            for (const vert *root : roots)
-                _dfs_util<stepper>(result, visited, roots);
+            context ctx;
+            _dfs<stepper>(ctx, roots, include_all{ }, _append_to(result));
             return result;
         }
 
         static constexpr auto dfs_f = &dfs<forward>;
         static constexpr auto dfs_r = &dfs<backward>;
 
-        // see https://en.wikipedia.org/wiki/Depth-first_search
-        // 1  procedure DFS_iterative(G, v) is
+        // Context forms, as for bfs_into and bfs_each
+        template<stepper_class stepper, class _Filter = include_all>
+        static void dfs_into(_Inout_ context &ctx, _In_ const std::vector<const vert *> &roots, _Outref_ step_vector &out,
+                             _In_ _Filter include = { })
+        {
+            _dfs<stepper>(ctx, roots, include, _append_to(out));
+        }
+
+        template<stepper_class stepper, class _Visit, class _Filter = include_all>
+        static void dfs_each(_Inout_ context &ctx, _In_ const std::vector<const vert *> &roots, _In_ _Visit visit,
+                             _In_ _Filter include = { })
+        {
+            _dfs<stepper>(ctx, roots, include, visit);
+        }
+
+        // Doesn't recurse, so it is safe on deep graphs
         template<stepper_class stepper>
         static void dfs_stack(_Outref_ step_vector &result, _In_ const std::vector<const vert *> &roots)
         {
-            // 2  let S be a stack
-            
-            // 3  S.push(v)
-            
-            // 4  while S is not empty do
-            
-            // 5  v = S.pop( )
-            
-            // 6  if v is not labeled as discovered then
-            
-            // 7  label v as discovered
-            
-            // 8  for all edges from v to w in G.adjacentEdges(v) do
-            
-            // 9  S.push(w)
+            context ctx;
+            _dfs_stack<stepper>(ctx, roots, include_all{ }, _append_to(result));
         }
 
         static constexpr auto dfs_stack_f = &dfs_stack<forward>;
         static constexpr auto dfs_stack_r = &dfs_stack<backward>;
+
+        // Context forms, as for bfs_into and bfs_each
+        template<stepper_class stepper, class _Filter = include_all>
+        static void dfs_stack_into(_Inout_ context &ctx, _In_ const std::vector<const vert *> &roots, _Outref_ step_vector &out,
+                                   _In_ _Filter include = { })
+        {
+            _dfs_stack<stepper>(ctx, roots, include, _append_to(out));
+        }
+
+        template<stepper_class stepper, class _Visit, class _Filter = include_all>
+        static void dfs_stack_each(_Inout_ context &ctx, _In_ const std::vector<const vert *> &roots, _In_ _Visit visit,
+                                   _In_ _Filter include = { })
+        {
+            _dfs_stack<stepper>(ctx, roots, include, visit);
+        }
+    };
+
+    // Runs independent breadth-first queries against one graph on a work-stealing pool.
+    // Queries are started in submission order; each worker keeps its own walk_context and result
+    // buffer between queries.
+    // The graph must not be modified while queries are in flight.
+    template<class _VTy, class _ETy>
+    class query_engine
+    {
+    public:
+        using vert = vert<_VTy, _ETy>;
+        using edge = edge<_VTy, _ETy>;
+        using graph_type = _graph_base<_VTy, _ETy>;
+        using walk_type = walk<_VTy, _ETy>;
+        using step_vector = typename walk_type::step_vector;
+
+        struct query
+        {
+            std::vector<const vert *> roots;
+            walk_limits limits;
+            const subgraph_view<_VTy, _ETy> *view = nullptr; // stays inside it if set; must outlive the query
+        };
+
+        explicit query_engine(
+            _In_ const graph_type &g,
+            _In_ size_t num_workers = std::thread::hardware_concurrency( )
+            ) :
+            _graph(g)
+        {
+            num_workers = num_workers ? num_workers : 1;
+            for (size_t i = 0; i < num_workers; ++i)
+                _workers.push_back(std::make_unique<worker>( ));
+            for (size_t i = 0; i < num_workers; ++i)
+                _threads.emplace_back(&query_engine::_worker_loop, this, i);
+        }
+
+        query_engine(const query_engine &) = delete;
+        query_engine &operator=(const query_engine &) = delete;
+
+        // Finishes every query already submitted before returning
+        ~query_engine( )
+        {
+            {
+                std::lock_guard lock(_sleep_mutex);
+                _stopping = true;
+            }
+            _wake.notify_all( );
+            for (std::thread &t : _threads)
+                t.join( );
+        }
+
+        size_t worker_count( ) const { return _workers.size( ); }
+
+        // The result is copied out of the worker's buffer; if the query fails, the future holds the exception
+        template<stepper_class stepper>
+        std::future<step_vector> submit(
+            _In_ query q
+        )
+        {
+            auto result = std::make_shared<std::promise<step_vector>>( );
+            std::future<step_vector> future = result->get_future( );
+            _push([this, q = std::move(q), result](worker &w)
+            {
+                try
+                {
+                    _run<stepper>(w, q);
+                    result->set_value(w.steps);
+                }
+                catch (...)
+                {
+                    result->set_exception(std::current_exception( ));
+                }
+            });
+            return future;
+        }
+
+        // callback(const step_vector &) is called on the worker thread with the worker's own buffer,
+        // which is reused by the next query; copy anything that must outlive the call.
+        // callback should not throw: anything it throws is discarded so the worker carries on with the
+        // other queries, and if the query itself fails (out of memory) callback is not called at all.
+        template<stepper_class stepper, class _Fn>
+        void submit(
+            _In_ query q,
+            _In_ _Fn callback
+        )
+        {
+            _push([this, q = std::move(q), callback = std::move(callback)](worker &w) mutable
+            {
+                try
+                {
+                    _run<stepper>(w, q);
+                    callback(static_cast<const step_vector &>(w.steps));
+                }
+                catch (...)
+                {
+                }
+            });
+        }
+
+    private:
+        struct worker;
+        using task = std::function<void(worker &)>;
+
+        struct worker
+        {
+            // Owner and thieves both take the oldest task, so queries run in submission order
+            std::mutex mutex;
+            std::deque<task> tasks;
+
+            typename walk_type::context context;
+            step_vector steps;
+        };
+
+        void _push(
+            _In_ task t
+        )
+        {
+            worker &w = *_workers[_next_worker.fetch_add(1, std::memory_order_relaxed) % _workers.size( )];
+
+            // Counted before it is published, so a worker that takes it straight away can't take _pending below zero
+            _pending.fetch_add(1);
+            try
+            {
+                std::lock_guard lock(w.mutex);
+                w.tasks.push_back(std::move(t));
+            }
+            catch (...)
+            {
+                _pending.fetch_sub(1);
+                throw;
+            }
+
+            // A worker going to sleep counts itself before checking _pending, so either it sees this task
+            // or we see it and wake it; the lock only ensures it is really waiting before the notify.
+            if (_sleepers.load( ) != 0)
+            {
+                { std::lock_guard lock(_sleep_mutex); }
+                _wake.notify_one( );
+            }
+        }
+
+        bool _take(
+            _In_ size_t self,
+            _Out_ task &t
+        )
+        {
+            worker &own = *_workers[self];
+            {
+                std::lock_guard lock(own.mutex);
+                if (!own.tasks.empty( ))
+                {
+                    t = std::move(own.tasks.front( ));
+                    own.tasks.pop_front( );
+                    return true;
+                }
+            }
+
+            for (size_t i = 1; i < _workers.size( ); ++i)
+            {
+                worker &victim = *_workers[(self + i) % _workers.size( )];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.tasks.empty( ))
+                {
+                    t = std::move(victim.tasks.front( ));
+                    victim.tasks.pop_front( );
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void _worker_loop(
+            _In_ size_t self
+        )
+        {
+            worker &w = *_workers[self];
+            for (;;)
+            {
+                task t;
+                if (_take(self, t))
+                {
+                    _pending.fetch_sub(1);
+                    t(w);
+                    continue;
+                }
+
+                std::unique_lock lock(_sleep_mutex);
+                if (_pending.load( ) == 0 && _stopping) return;
+                _sleepers.fetch_add(1);
+                _wake.wait(lock, [this]( ) { return _pending.load( ) != 0 || _stopping; });
+                _sleepers.fetch_sub(1);
+            }
+        }
+
+        template<stepper_class stepper>
+        void _run(
+            _Inout_ worker &w,
+            _In_ const query &q
+        ) const
+        {
+            // Size the marks up front so queries don't grow them one by one
+            if (w.context.marks.size( ) < _graph.vert_count( ))
+                w.context.marks.resize(_graph.vert_count( ), 0);
+
+            if (q.view)
+                walk_type::template bfs_into<stepper>(w.context, q.roots, w.steps, q.view->filter( ), q.limits);
+            else
+                walk_type::template bfs_into<stepper>(w.context, q.roots, w.steps, typename walk_type::include_all{ }, q.limits);
+        }
+
+        const graph_type &_graph;
+        std::vector<std::unique_ptr<worker>> _workers;
+        std::vector<std::thread> _threads;
+        std::atomic<size_t> _next_worker = 0;
+
+        std::atomic<size_t> _pending = 0, _sleepers = 0;
+        std::mutex _sleep_mutex;
+        std::condition_variable _wake;
+        bool _stopping = false;
+    };
+
+    // Fixed-capacity graph for small, known shapes such as state machines and pipelines.
+    // Everything lives in arrays and each vertex's edges are a 64-bit mask of neighbour ids,
+    // so traversals are bit operations and everything is usable in constant expressions.
+    // _VTy (and _ETy) must be default constructible. Parallel edges are not representable.
+    template<class _VTy, class _ETy = void, size_t MaxV = 64, size_t MaxE = MaxV * 4>
+    class static_graph
+    {
+        static_assert(MaxV <= 64, "adjacency masks are 64 bits wide");
+
+        struct _no_data { };
+        using _edge_data = std::conditional_t<std::is_void_v<_ETy>, _no_data, _ETy>;
+
+    public:
+        using mask = uint64_t;
+
+        static constexpr size_t npos = SIZE_MAX;
+
+        // Vertex ids in visit order
+        struct order
+        {
+            std::array<size_t, MaxV> ids{ };
+            size_t count = 0;
+
+            constexpr size_t size( ) const { return count; }
+            constexpr size_t operator[](size_t i) const { return ids[i]; }
+            constexpr auto begin( ) const { return ids.begin( ); }
+            constexpr auto end  ( ) const { return ids.begin( ) + count; }
+        };
+
+        constexpr size_t vert_count( ) const { return _num_verts; }
+        constexpr size_t edge_count( ) const { return _num_edges; }
+
+        // Returns the id of the new vertex, or npos if MaxV verts are already in use
+        constexpr size_t push(
+            _In_ const _VTy &value
+        )
+        {
+            if (_num_verts == MaxV) return npos;
+            _verts[_num_verts] = value;
+            return _num_verts++;
+        }
+
+        constexpr       _VTy &at(_In_range_(<, vert_count( )) size_t v)       { return _verts[v]; }
+        constexpr const _VTy &at(_In_range_(<, vert_count( )) size_t v) const { return _verts[v]; }
+
+        // Returns false if the verts are already linked in this direction, or if MaxE edges are already in use
+        constexpr bool link(
+            _In_ size_t prev,
+            _In_ size_t next
+        ) requires std::is_void_v<_ETy>
+        {
+            return _link(prev, next) != npos;
+        }
+
+        // As above
+        constexpr bool link(
+            _In_ size_t prev,
+            _In_ size_t next,
+            _In_ const _edge_data &value
+        ) requires (!std::is_void_v<_ETy>)
+        {
+            size_t e = _link(prev, next);
+            if (e == npos) return false;
+            _edge_values[e] = value;
+            return true;
+        }
+
+        // Edge id from prev to next, or npos
+        constexpr size_t edge_between(
+            _In_ size_t prev,
+            _In_ size_t next
+        ) const
+        {
+            if (!(_next[prev] & _bit(next))) return npos;
+            for (size_t e = 0; e < _num_edges; ++e)
+            {
+                if (_edges[e].prev == prev && _edges[e].next == next) return e;
+            }
+            return npos;
+        }
+
+        constexpr size_t edge_prev(_In_range_(<, edge_count( )) size_t e) const { return _edges[e].prev; }
+        constexpr size_t edge_next(_In_range_(<, edge_count( )) size_t e) const { return _edges[e].next; }
+
+        constexpr       _edge_data &edge_at(_In_range_(<, edge_count( )) size_t e)       requires (!std::is_void_v<_ETy>) { return _edge_values[e]; }
+        constexpr const _edge_data &edge_at(_In_range_(<, edge_count( )) size_t e) const requires (!std::is_void_v<_ETy>) { return _edge_values[e]; }
+
+        constexpr mask next_mask(_In_range_(<, vert_count( )) size_t v) const { return _next[v]; }
+        constexpr mask prev_mask(_In_range_(<, vert_count( )) size_t v) const { return _prev[v]; }
+
+        // Every vertex reachable from roots (a mask of ids), including the roots
+        constexpr mask reachable(
+            _In_ mask roots,
+            _In_ bool forward = true
+        ) const
+        {
+            mask visited = roots, frontier = roots;
+            while (frontier)
+            {
+                mask reached = 0;
+                for (mask rest = frontier; rest; rest &= rest - 1)
+                    reached |= _step(std::countr_zero(rest), forward);
+                frontier = reached & ~visited;
+                visited |= frontier;
+            }
+            return visited;
+        }
+
+        // see https://en.wikipedia.org/wiki/Breadth-first_search
+        // Neighbours are visited in ascending id order
+        constexpr order bfs(
+            _In_ size_t root,
+            _In_ bool forward = true
+        ) const
+        {
+            order result;
+            mask visited = _bit(root);
+            result.ids[result.count++] = root;
+
+            // result doubles as the queue
+            for (size_t head = 0; head < result.count; ++head)
+            {
+                mask fresh = _step(result.ids[head], forward) & ~visited;
+                visited |= fresh;
+                for (; fresh; fresh &= fresh - 1)
+                    result.ids[result.count++] = std::countr_zero(fresh);
+            }
+            return result;
+        }
+
+        // see https://en.wikipedia.org/wiki/Depth-first_search
+        // Preorder; neighbours are explored in ascending id order
+        constexpr order dfs(
+            _In_ size_t root,
+            _In_ bool forward = true
+        ) const
+        {
+            order result;
+            mask visited = _bit(root);
+            result.ids[result.count++] = root;
+
+            // Each frame holds the neighbours of a vertex still left to explore
+            std::array<mask, MaxV> frames{ };
+            size_t depth = 0;
+            frames[depth++] = _step(root, forward);
+
+            while (depth)
+            {
+                mask pending = frames[depth - 1] & ~visited;
+                if (!pending)
+                {
+                    --depth;
+                    continue;
+                }
+
+                size_t w = std::countr_zero(pending);
+                frames[depth - 1] = pending & (pending - 1);
+                visited |= _bit(w);
+                result.ids[result.count++] = w;
+                frames[depth++] = _step(w, forward);
+            }
+            return result;
+        }
+
+        // see https://en.wikipedia.org/wiki/Topological_sorting#Kahn's_algorithm
+        // Takes every ready vertex at once, in ascending id order.
+        // The result is shorter than vert_count( ) if the graph has a cycle.
+        constexpr order topological_sort( ) const
+        {
+            order result;
+            mask remaining = _num_verts == 64 ? ~mask(0) : _bit(_num_verts) - 1;
+            while (remaining)
+            {
+                mask ready = 0;
+                for (mask rest = remaining; rest; rest &= rest - 1)
+                {
+                    size_t v = std::countr_zero(rest);
+                    if (!(_prev[v] & remaining)) ready |= _bit(v);
+                }
+                if (!ready) break;
+
+                remaining &= ~ready;
+                for (; ready; ready &= ready - 1)
+                    result.ids[result.count++] = std::countr_zero(ready);
+            }
+            return result;
+        }
+
+    private:
+        struct _edge_ends
+        {
+            size_t prev = 0, next = 0;
+        };
+
+        static constexpr mask _bit(size_t v) { return mask(1) << v; }
+
+        constexpr mask _step(size_t v, bool forward) const { return forward ? _next[v] : _prev[v]; }
+
+        constexpr size_t _link(
+            _In_ size_t prev,
+            _In_ size_t next
+        )
+        {
+            assert(prev < _num_verts && next < _num_verts && prev != next);
+            if (_num_edges == MaxE || (_next[prev] & _bit(next))) return npos;
+
+            _next[prev] |= _bit(next);
+            _prev[next] |= _bit(prev);
+            _edges[_num_edges] = { prev, next };
+            return _num_edges++;
+        }
+
+        std::array<_VTy, MaxV> _verts{ };
+        std::array<mask, MaxV> _next{ }, _prev{ };
+        std::array<_edge_ends, MaxE> _edges{ };
+        std::array<_edge_data, std::is_void_v<_ETy> ? 0 : MaxE> _edge_values{ };
+        size_t _num_verts = 0, _num_edges = 0;
     };
 }
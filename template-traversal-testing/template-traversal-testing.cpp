@@ -2,12 +2,160 @@
 #include "CppUnitTest.h"
 #include <graph-traversal.hpp>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <stdexcept>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 using namespace trav;
 
 namespace templatetraversaltesting
 {
+	namespace
+	{
+		// Links count random pairs of distinct verts
+		template<class _Graph>
+		void link_random(_Graph &g, size_t count, std::mt19937 &rng)
+		{
+			for (size_t k = 0; k < count; ++k)
+			{
+				size_t a = rng( ) % g.vert_count( ), b = rng( ) % g.vert_count( );
+				if (a != b) g.link(g.at(a), g.at(b));
+			}
+		}
+
+		// Weakly-connected component ids by a serial breadth-first search from each unvisited vert in index order
+		template<class _Graph>
+		std::vector<size_t> serial_components(const _Graph &g)
+		{
+			std::vector<size_t> id(g.vert_count( ), SIZE_MAX), queue;
+			size_t next_id = 0;
+			for (size_t root = 0; root < g.vert_count( ); ++root)
+			{
+				if (id[root] != SIZE_MAX) continue;
+				id[root] = next_id;
+				queue.assign(1, root);
+				for (size_t head = 0; head < queue.size( ); ++head)
+				{
+					const auto &v = g.at(queue[head]);
+					auto reach = [&](size_t w)
+					{
+						if (id[w] == SIZE_MAX)
+						{
+							id[w] = next_id;
+							queue.push_back(w);
+						}
+					};
+					for (const auto *e : v.next( )) reach(e->next( ).index( ));
+					for (const auto *e : v.prev( )) reach(e->prev( ).index( ));
+				}
+				++next_id;
+			}
+			return id;
+		}
+
+		// topological_order( ) holds every vert once, topological_index( ) agrees with it, and every edge points forward
+		template<class _Graph>
+		bool is_topological(const _Graph &g)
+		{
+			const auto &order = g.topological_order( );
+			if (order.size( ) != g.vert_count( )) return false;
+			for (size_t i = 0; i < order.size( ); ++i)
+			{
+				if (g.topological_index(*order[i]) != i) return false;
+			}
+			for (const auto &e : g.all_edges( ))
+			{
+				if (g.topological_index(e.prev( )) >= g.topological_index(e.next( ))) return false;
+			}
+			return true;
+		}
+
+		// Every index( ) matches its position, and every edge is listed by both of its ends
+		template<class _Graph>
+		bool is_consistent(const _Graph &g)
+		{
+			size_t num_next = 0, num_prev = 0;
+			for (size_t i = 0; i < g.vert_count( ); ++i)
+			{
+				const auto &v = g.at(i);
+				if (v.index( ) != i) return false;
+				num_next += v.next_count( );
+				num_prev += v.prev_count( );
+			}
+
+			size_t i = 0;
+			for (const auto &e : g.all_edges( ))
+			{
+				if (e.index( ) != i++) return false;
+				const auto &next = e.prev( ).next( ), &prev = e.next( ).prev( );
+				if (std::find(next.begin( ), next.end( ), &e) == next.end( )) return false;
+				if (std::find(prev.begin( ), prev.end( ), &e) == prev.end( )) return false;
+			}
+			return num_next == g.edge_count( ) && num_prev == g.edge_count( );
+		}
+
+		// (prev, next, edge) payloads, which identify edges independently of their positions
+		std::multiset<std::tuple<int, int, int>> edge_payloads(const graph<int, int> &g)
+		{
+			std::multiset<std::tuple<int, int, int>> result;
+			for (const auto &e : g.all_edges( ))
+				result.emplace(static_cast<const int &>(e.prev( )), static_cast<const int &>(e.next( )), static_cast<const int &>(e));
+			return result;
+		}
+
+		// Payload for the scans; find_all_batched projects it down to key
+		struct reading
+		{
+			int key;
+			double value;
+		};
+
+		template<class _Order>
+		constexpr bool is_order(const _Order &o, std::initializer_list<size_t> ids)
+		{
+			return std::equal(o.begin( ), o.end( ), ids.begin( ), ids.end( ));
+		}
+
+		// 0 -> 1 and 2 -> 3 -> 4, optionally closed by 4 -> 1
+		constexpr static_graph<int> make_diamond(bool cycle)
+		{
+			static_graph<int> g;
+			for (int i = 0; i < 5; ++i)
+				g.push(i);
+			g.link(0, 1);
+			g.link(0, 2);
+			g.link(1, 3);
+			g.link(2, 3);
+			g.link(3, 4);
+			if (cycle) g.link(4, 1);
+			return g;
+		}
+
+		// 0 -> 1 -> ... -> 63, using every bit of the masks
+		constexpr static_graph<int> make_chain( )
+		{
+			static_graph<int> g;
+			for (int i = 0; i < 64; ++i)
+				g.push(i);
+			for (size_t i = 1; i < 64; ++i)
+				g.link(i - 1, i);
+			return g;
+		}
+
+		constexpr static_graph<char, int, 8> make_weighted( )
+		{
+			static_graph<char, int, 8> g;
+			g.push('a');
+			g.push('b');
+			g.push('c');
+			g.link(0, 1, 10);
+			g.link(1, 2, 20);
+			return g;
+		}
+	}
+
 	TEST_CLASS(templatetraversaltesting)
 	{
 	public:
@@ -16,5 +164,639 @@ namespace templatetraversaltesting
 		{
 
 		}
+
+		TEST_METHOD(TestConnectedComponents)
+		{
+			std::mt19937 rng(27);
+
+			// Small enough to run serially, then large enough to be split across the pool
+			for (size_t num_verts : { 200, 100000 })
+			{
+				graph<int> g;
+				for (size_t i = 0; i < num_verts; ++i)
+					g.push(static_cast<int>(i));
+				link_random(g, num_verts * 2 / 3, rng);
+
+				components c = g.connected_components( );
+				std::vector<size_t> expected = serial_components(g);
+				Assert::IsTrue(c.id == expected);
+
+				std::vector<size_t> sizes(c.count( ), 0);
+				for (size_t id : expected)
+					++sizes[id];
+				Assert::IsTrue(c.sizes == sizes);
+			}
+
+			graph<int> empty;
+			Assert::AreEqual(size_t(0), empty.connected_components( ).count( ));
+		}
+
+		TEST_METHOD(TestTopologicalOrder)
+		{
+			using walk_type = walk<int, void>;
+			std::mt19937 rng(29);
+
+			graph<int> g;
+			for (int i = 0; i < 200; ++i)
+				g.push(i);
+			Assert::IsTrue(g.enable_topological_order( ));
+
+			size_t refused = 0;
+			for (int k = 0; k < 2000; ++k)
+			{
+				auto &a = g.at(rng( ) % g.vert_count( )), &b = g.at(rng( ) % g.vert_count( ));
+				if (&a == &b || g.edge_between(a, b)) continue;
+
+				// a -> b closes a cycle exactly when a is already reachable from b
+				bool cycle = false;
+				for (const auto &[e, v] : walk_type::bfs_f({ &b }))
+					cycle |= v == &a;
+
+				Assert::AreEqual(!cycle, g.link(a, b));
+				refused += cycle;
+				Assert::IsTrue(is_topological(g));
+
+				if (k % 100 == 0)
+				{
+					g.erase(g.at(rng( ) % g.vert_count( )));
+					g.push(1000 + k);
+					Assert::IsTrue(is_topological(g));
+				}
+			}
+			Assert::IsTrue(refused > 0);
+			Assert::IsTrue(g.maintains_topological_order( ));
+
+			graph<int> cyclic;
+			cyclic.push(0);
+			cyclic.push(1);
+			cyclic.link(cyclic.at(0), cyclic.at(1));
+			cyclic.link(cyclic.at(1), cyclic.at(0));
+			Assert::IsFalse(cyclic.enable_topological_order( ));
+			Assert::IsFalse(cyclic.maintains_topological_order( ));
+		}
+
+		TEST_METHOD(TestBatch)
+		{
+			std::mt19937 rng(36);
+			const int num_verts = 3000;
+
+			// The same edits made directly and through a batch
+			graph<int, int> direct, batched;
+			for (int i = 0; i < num_verts; ++i)
+			{
+				direct.push(i);
+				batched.push(i);
+			}
+			for (int k = 0; k < num_verts * 3; ++k)
+			{
+				int a = rng( ) % num_verts, b = rng( ) % num_verts;
+				if (a == b) continue;
+				direct.link(direct.at(a), direct.at(b), k);
+				batched.link(batched.at(a), batched.at(b), k);
+			}
+
+			std::set<size_t> erased;
+			while (erased.size( ) < 300)
+				erased.insert(rng( ) % num_verts);
+			auto &unlinked = *direct.all_edges( ).begin( );
+			size_t unlinked_from = unlinked.prev( ).index( ), unlinked_to = unlinked.next( ).index( );
+
+			{
+				auto batch = batched.begin_batch( );
+				batch.unlink(batched.at(unlinked_from), batched.at(unlinked_to));
+				for (size_t i : erased)
+					batch.erase(batched.at(i));
+				auto &pushed = batch.push(num_verts);
+				batch.link(batched.at(*erased.begin( )), pushed, -1); // dropped with its erased end
+				batch.link(pushed, batched.at(num_verts - 1), -2);
+			}
+
+			direct.unlink(direct.at(unlinked_from), direct.at(unlinked_to));
+			for (auto it = erased.rbegin( ); it != erased.rend( ); ++it)
+				direct.erase(direct.at(*it));
+			direct.push(num_verts);
+			if (!erased.count(num_verts - 1))
+				direct.link(direct.at(direct.vert_count( ) - 1), direct.at(direct.vert_count( ) - 2), -2);
+
+			Assert::IsTrue(is_consistent(direct));
+			Assert::IsTrue(is_consistent(batched));
+			Assert::AreEqual(direct.vert_count( ), batched.vert_count( ));
+			for (size_t i = 0; i < direct.vert_count( ); ++i)
+				Assert::AreEqual(static_cast<int &>(direct.at(i)), static_cast<int &>(batched.at(i)));
+			Assert::IsTrue(edge_payloads(direct) == edge_payloads(batched));
+
+			// Links that would close a cycle are refused at commit
+			graph<int, int> dag;
+			for (int i = 0; i < 5; ++i)
+				dag.push(i);
+			Assert::IsTrue(dag.enable_topological_order( ));
+			{
+				auto batch = dag.begin_batch( );
+				batch.link(dag.at(0), dag.at(1), 0);
+				batch.link(dag.at(1), dag.at(2), 0);
+				batch.link(dag.at(2), dag.at(0), 0);
+				batch.erase(dag.at(4));
+				Assert::AreEqual(size_t(1), batch.commit( ));
+			}
+			Assert::AreEqual(size_t(4), dag.vert_count( ));
+			Assert::AreEqual(size_t(2), dag.edge_count( ));
+			Assert::IsTrue(is_consistent(dag));
+			Assert::IsTrue(is_topological(dag));
+
+			// Unlinking the same pair twice removes two parallel edges, as it does directly
+			graph<int, int> parallel;
+			parallel.push(0);
+			parallel.push(1);
+			for (int k = 0; k < 3; ++k)
+				parallel.link(parallel.at(0), parallel.at(1), k);
+			{
+				auto batch = parallel.begin_batch( );
+				batch.unlink(parallel.at(0), parallel.at(1));
+				batch.unlink(parallel.at(0), parallel.at(1));
+				Assert::AreEqual(size_t(0), batch.commit( ));
+
+				// Nothing left queued, so leaving the scope doesn't touch the graph
+				Assert::AreEqual(size_t(0), batch.commit( ));
+			}
+			Assert::AreEqual(size_t(1), parallel.edge_count( ));
+			Assert::IsTrue(is_consistent(parallel));
+		}
+
+		TEST_METHOD(TestQueryEngine)
+		{
+			using walk_type = walk<int, void>;
+			using engine_type = query_engine<int, void>;
+			std::mt19937 rng(31);
+
+			graph<int> g;
+			for (int i = 0; i < 2000; ++i)
+				g.push(i);
+			link_random(g, 4000, rng);
+
+			// Same results as a plain walk, whichever worker runs them
+			{
+				engine_type engine(g, 4);
+				std::vector<const vert<int> *> roots;
+				std::vector<std::future<walk_type::step_vector>> results;
+				for (int k = 0; k < 64; ++k)
+				{
+					roots.push_back(&g.at(rng( ) % g.vert_count( )));
+					results.push_back(k % 2 ? engine.submit<walk_type::forward>({ { roots.back( ) } })
+					                        : engine.submit<walk_type::backward>({ { roots.back( ) } }));
+				}
+				for (int k = 0; k < 64; ++k)
+					Assert::IsTrue(results[k].get( ) == (k % 2 ? walk_type::bfs_f({ roots[k] }) : walk_type::bfs_r({ roots[k] })));
+			}
+
+			// Limits, and views through the include filter
+			{
+				engine_type engine(g, 2);
+				const vert<int> *root = &g.at(0);
+				auto full = walk_type::bfs_f({ root });
+
+				Assert::AreEqual(size_t(1), engine.submit<walk_type::forward>({ { root }, { 0, SIZE_MAX } }).get( ).size( ));
+				auto first_steps = engine.submit<walk_type::forward>({ { root }, { SIZE_MAX, 5 } }).get( );
+				Assert::IsTrue(first_steps == walk_type::step_vector(full.begin( ), full.begin( ) + std::min<size_t>(5, full.size( ))));
+
+				std::vector<vert<int> *> selection;
+				for (size_t i = 0; i < g.vert_count( ); i += 2)
+					selection.push_back(&g.at(i));
+				subgraph_view<int, void> view(g, selection);
+				Assert::IsTrue(engine.submit<walk_type::forward>({ { root }, { }, &view }).get( ) == walk_type::bfs_within_f(view, { root }));
+			}
+
+			// A single worker runs queries in submission order
+			std::vector<int> order;
+			{
+				engine_type engine(g, 1);
+				for (int k = 0; k < 16; ++k)
+					engine.submit<walk_type::forward>({ { &g.at(k) } }, [&order, k](const walk_type::step_vector &) { order.push_back(k); });
+			}
+			Assert::AreEqual(size_t(16), order.size( ));
+			for (int k = 0; k < 16; ++k)
+				Assert::AreEqual(k, order[k]);
+
+			// A throwing callback doesn't take its worker down with it
+			{
+				engine_type engine(g, 1);
+				engine.submit<walk_type::forward>({ { &g.at(0) } }, [ ](const walk_type::step_vector &) { throw std::runtime_error("callback failed"); });
+				Assert::IsTrue(engine.submit<walk_type::forward>({ { &g.at(0) } }).get( ) == walk_type::bfs_f({ &g.at(0) }));
+			}
+		}
+
+		TEST_METHOD(TestOwnership)
+		{
+			std::mt19937 rng(26);
+
+			// Serially, then above clone_grain so the copy is split across the pool
+			for (int num_verts : { 100, 20000 })
+			{
+				graph<int, int> g;
+				for (int i = 0; i < num_verts; ++i)
+					g.push(i);
+				for (int k = 0; k < num_verts * 2; ++k)
+				{
+					int a = rng( ) % num_verts, b = rng( ) % num_verts;
+					if (a != b) g.link(g.at(a), g.at(b), k);
+				}
+
+				graph<int, int> copy = g.clone( );
+				Assert::IsTrue(is_consistent(copy));
+				Assert::AreEqual(g.vert_count( ), copy.vert_count( ));
+				for (size_t i = 0; i < g.vert_count( ); ++i)
+					Assert::AreEqual(static_cast<int &>(g.at(i)), static_cast<int &>(copy.at(i)));
+				Assert::IsTrue(edge_payloads(g) == edge_payloads(copy));
+				for (const auto &e : copy.all_edges( ))
+				{
+					Assert::IsTrue(&e.prev( ) == &copy.at(e.prev( ).index( )));
+					Assert::IsTrue(&e.next( ) == &copy.at(e.next( ).index( )));
+				}
+			}
+
+			graph<int, int> a;
+			for (int i = 0; i < 3; ++i)
+				a.push(i);
+			a.link(a.at(0), a.at(1), 10);
+			a.link(a.at(1), a.at(2), 11);
+			auto *first = &a.at(0);
+
+			// Moving hands over the verts themselves and leaves the source empty
+			graph<int, int> b(std::move(a));
+			Assert::IsTrue(a.empty( ));
+			Assert::AreEqual(size_t(0), a.edge_count( ));
+			Assert::IsTrue(&b.at(0) == first);
+			Assert::AreEqual(size_t(2), b.edge_count( ));
+
+			graph<int, int> c;
+			c.push(7);
+			c = std::move(b);
+			Assert::IsTrue(b.empty( ));
+			Assert::IsTrue(&c.at(0) == first);
+			Assert::IsTrue(is_consistent(c));
+
+			// The moved-from graph is still usable
+			b.push(1);
+			b.push(2);
+			b.link(b.at(0), b.at(1), 12);
+			Assert::IsTrue(is_consistent(b));
+
+			b.swap(c);
+			Assert::AreEqual(size_t(3), b.vert_count( ));
+			Assert::AreEqual(size_t(2), c.vert_count( ));
+			Assert::IsTrue(&b.at(0) == first);
+			Assert::AreEqual(12, static_cast<int &>(*c.all_edges( ).begin( )));
+
+			b.clear( );
+			Assert::IsTrue(b.empty( ));
+			Assert::AreEqual(size_t(0), b.edge_count( ));
+			b.push(3);
+			b.push(4);
+			b.link(b.at(1), b.at(0), 13);
+			Assert::IsTrue(is_consistent(b));
+			Assert::AreEqual(size_t(1), b.at(1).index( ));
+			Assert::AreEqual(size_t(0), (*b.all_edges( ).begin( )).index( ));
+
+			// The first exception from any chunk reaches the caller, after every chunk has finished
+			thread_pool pool(4);
+			std::atomic<size_t> visited = 0;
+			bool caught = false;
+			try
+			{
+				pool.parallel_for(1000, 10, [&visited](size_t begin, size_t end)
+				{
+					visited += end - begin;
+					if (begin == 0) throw std::runtime_error("chunk failed");
+				});
+			}
+			catch (const std::runtime_error &)
+			{
+				caught = true;
+			}
+			Assert::IsTrue(caught);
+			Assert::IsTrue(visited.load( ) <= 1000);
+
+			// The pool is still usable afterwards
+			visited = 0;
+			pool.parallel_for(1000, 10, [&visited](size_t begin, size_t end) { visited += end - begin; });
+			Assert::AreEqual(size_t(1000), visited.load( ));
+		}
+
+		TEST_METHOD(TestReorder)
+		{
+			for (vert_order strategy : { vert_order::bfs, vert_order::reverse_cuthill_mckee, vert_order::degree })
+			{
+				std::mt19937 rng(28);
+
+				// Edges only go from lower to higher payloads, so a topological order can be kept
+				graph<int, int> g;
+				for (int i = 0; i < 500; ++i)
+					g.push(i);
+				Assert::IsTrue(g.enable_topological_order( ));
+				for (int k = 0; k < 1000; ++k)
+				{
+					int a = rng( ) % 500, b = rng( ) % 500;
+					if (a < b) g.link(g.at(a), g.at(b), k);
+				}
+
+				auto before = edge_payloads(g);
+				g.reorder(strategy);
+				Assert::IsTrue(is_consistent(g));
+				Assert::AreEqual(size_t(500), g.vert_count( ));
+				Assert::IsTrue(edge_payloads(g) == before);
+				Assert::IsTrue(g.maintains_topological_order( ));
+				Assert::IsTrue(is_topological(g));
+
+				// Payloads are moved, not copied
+				graph<std::unique_ptr<int>, std::unique_ptr<int>> owning;
+				for (int i = 0; i < 50; ++i)
+					owning.push(std::make_unique<int>(i));
+				for (int i = 1; i < 50; ++i)
+					owning.link(owning.at(i - 1), owning.at(i), std::make_unique<int>(i));
+				owning.reorder(strategy);
+
+				std::vector<bool> seen(50, false);
+				for (const auto &v : owning.all_verts( ))
+				{
+					const auto &payload = static_cast<const std::unique_ptr<int> &>(v);
+					Assert::IsTrue(payload != nullptr);
+					seen[*payload] = true;
+				}
+				Assert::IsTrue(std::find(seen.begin( ), seen.end( ), false) == seen.end( ));
+				for (const auto &e : owning.all_edges( ))
+				{
+					const auto &payload = static_cast<const std::unique_ptr<int> &>(e);
+					Assert::AreEqual(*payload, *static_cast<const std::unique_ptr<int> &>(e.next( )));
+					Assert::AreEqual(*payload - 1, *static_cast<const std::unique_ptr<int> &>(e.prev( )));
+				}
+			}
+		}
+
+		TEST_METHOD(TestParallelFind)
+		{
+			// Below scan_grain the scans run serially; above it they are split across the pool
+			for (int num_verts : { 1000, 100000 })
+			{
+				graph<reading> g;
+				for (int i = 0; i < num_verts; ++i)
+					g.push(reading{ (i * 7919) % 1009, double(i) });
+
+				auto key_is = [ ](const auto &v, int key) { return static_cast<const reading &>(v).key == key; };
+				for (int key : { 0, 500, 1008, -1 })
+				{
+					auto expected = g.find_all(key_is, key);
+					Assert::IsTrue(g.find_all_par(key_is, key) == expected);
+					Assert::AreEqual(expected.size( ), g.count_if(key_is, key));
+					Assert::IsTrue(g.find_first_par(key_is, key) == g.find(key_is, key));
+
+					auto batched = g.find_all_batched([key](std::span<const int> keys, std::span<bool> matches)
+					{
+						for (size_t i = 0; i < keys.size( ); ++i)
+							matches[i] = keys[i] == key;
+					}, [ ](const reading &r) { return r.key; });
+					Assert::IsTrue(batched == expected);
+				}
+				Assert::IsTrue(g.find_first_par(key_is, -1) == nullptr);
+			}
+		}
+
+		TEST_METHOD(TestCompressedAdjacency)
+		{
+			using walk_type = walk<int, void>;
+			using direction = compressed_adjacency::direction;
+			std::mt19937 rng(32);
+
+			// Above encode_grain, so it is encoded in several chunks, and many times sample_interval
+			graph<int> g;
+			for (int i = 0; i < 40000; ++i)
+				g.push(i);
+			link_random(g, 80000, rng);
+			compressed_adjacency adj(g);
+			Assert::AreEqual(g.vert_count( ), adj.vert_count( ));
+
+			std::vector<size_t> expected, decoded;
+			for (size_t i = 0; i < g.vert_count( ); ++i)
+			{
+				for (direction dir : { direction::forward, direction::backward })
+				{
+					expected.clear( );
+					if (dir == direction::forward)
+					{
+						for (const auto *e : g.at(i).next( ))
+							expected.push_back(e->next( ).index( ));
+					}
+					else
+					{
+						for (const auto *e : g.at(i).prev( ))
+							expected.push_back(e->prev( ).index( ));
+					}
+					std::sort(expected.begin( ), expected.end( ));
+
+					decoded.clear( );
+					adj.for_each_neighbour(i, dir, [&decoded](size_t w) { decoded.push_back(w); });
+					Assert::IsTrue(decoded == expected);
+					Assert::AreEqual(expected.size( ), adj.degree(i, dir));
+				}
+			}
+
+			// Neighbours come out in id order rather than link order, so compare what is reached
+			auto reached = [ ](std::vector<size_t> ids) { std::sort(ids.begin( ), ids.end( )); return ids; };
+			for (size_t root : { size_t(0), size_t(12345), size_t(39999) })
+			{
+				std::vector<size_t> walked;
+				for (const auto &[e, v] : walk_type::bfs_f({ &g.at(root) }))
+					walked.push_back(v->index( ));
+				Assert::IsTrue(reached(adj.bfs({ root }, direction::forward)) == reached(walked));
+				Assert::IsTrue(reached(adj.dfs({ root }, direction::forward)) == reached(walked));
+				Assert::AreEqual(root, adj.bfs({ root }, direction::forward).front( ));
+			}
+
+			// Smaller than even a plain array of neighbour indices
+			Assert::IsTrue(adj.memory_usage( ) > 0);
+			Assert::IsTrue(adj.memory_usage( ) < 2 * g.edge_count( ) * sizeof(size_t));
+		}
+
+		TEST_METHOD(TestSubgraphView)
+		{
+			std::mt19937 rng(33);
+			graph<int, int> g;
+			for (int i = 0; i < 300; ++i)
+				g.push(i);
+			for (int k = 0; k < 250; ++k)
+			{
+				int a = rng( ) % 300, b = rng( ) % 300;
+				if (a != b) g.link(g.at(a), g.at(b), k);
+			}
+
+			// Iteration agrees with the counts and with contains
+			auto check_counts = [ ](const subgraph_view<int, int> &view)
+			{
+				size_t num_verts = 0, num_edges = 0;
+				for (const auto &v : view.all_verts( ))
+				{
+					Assert::IsTrue(view.contains(v));
+					++num_verts;
+				}
+				for (const auto &e : view.all_edges( ))
+				{
+					Assert::IsTrue(view.contains(e));
+					++num_edges;
+				}
+				Assert::AreEqual(view.vert_count( ), num_verts);
+				Assert::AreEqual(view.edge_count( ), num_edges);
+			};
+
+			subgraph_view<int, int> whole(g);
+			check_counts(whole);
+			Assert::AreEqual(g.vert_count( ), whole.vert_count( ));
+			Assert::AreEqual(g.edge_count( ), whole.edge_count( ));
+
+			// A component view holds exactly that component's verts and every edge between them
+			components c = g.connected_components( );
+			size_t largest = std::max_element(c.sizes.begin( ), c.sizes.end( )) - c.sizes.begin( );
+			subgraph_view<int, int> component(g, c, largest);
+			check_counts(component);
+			Assert::AreEqual(c.sizes[largest], component.vert_count( ));
+			for (size_t i = 0; i < g.vert_count( ); ++i)
+				Assert::AreEqual(c.id[i] == largest, component.contains(g.at(i)));
+			for (const auto &e : g.all_edges( ))
+				Assert::AreEqual(c.id[e.prev( ).index( )] == largest, component.contains(e));
+
+			// Dropping edges keeps the verts
+			size_t num_even = 0;
+			for (const auto &e : component.all_edges( ))
+				num_even += static_cast<const int &>(e) % 2 == 0;
+			component.keep_edges_if([ ](const auto &e) { return static_cast<const int &>(e) % 2 == 0; });
+			check_counts(component);
+			Assert::AreEqual(c.sizes[largest], component.vert_count( ));
+			Assert::AreEqual(num_even, component.edge_count( ));
+			for (const auto &e : g.all_edges( ))
+				Assert::AreEqual(c.id[e.prev( ).index( )] == largest && static_cast<const int &>(e) % 2 == 0, component.contains(e));
+
+			// Induced by a selection
+			std::vector<vert<int, int> *> selection = g.find_all([ ](const auto &v) { return static_cast<const int &>(v) < 100; });
+			subgraph_view<int, int> induced(g, selection);
+			check_counts(induced);
+			Assert::AreEqual(size_t(100), induced.vert_count( ));
+			for (const auto &e : g.all_edges( ))
+				Assert::AreEqual(e.prev( ).index( ) < 100 && e.next( ).index( ) < 100, induced.contains(e));
+		}
+
+		TEST_METHOD(TestStaticGraph)
+		{
+			// All of these are checked by the compiler
+			constexpr auto diamond = make_diamond(false);
+			static_assert(diamond.vert_count( ) == 5 && diamond.edge_count( ) == 5);
+			static_assert(is_order(diamond.bfs(0), { 0, 1, 2, 3, 4 }));
+			static_assert(is_order(diamond.dfs(0), { 0, 1, 3, 4, 2 }));
+			static_assert(is_order(diamond.bfs(4, false), { 4, 3, 1, 2, 0 }));
+			static_assert(is_order(diamond.topological_sort( ), { 0, 1, 2, 3, 4 }));
+			static_assert(diamond.reachable(uint64_t(1) << 1) == 0b11010);
+			static_assert(diamond.reachable(uint64_t(1) << 3, false) == 0b01111);
+
+			// 4 -> 1 closes a cycle, so only 0 and 2 can be ordered
+			constexpr auto cyclic = make_diamond(true);
+			static_assert(is_order(cyclic.topological_sort( ), { 0, 2 }));
+			static_assert(cyclic.bfs(0).size( ) == 5);
+
+			constexpr auto chain = make_chain( );
+			static_assert(chain.vert_count( ) == 64 && chain.edge_count( ) == 63);
+			static_assert(chain.topological_sort( ).size( ) == 64 && chain.topological_sort( )[63] == 63);
+			static_assert(chain.dfs(0).size( ) == 64 && chain.bfs(63, false)[63] == 0);
+			static_assert(chain.reachable(1) == ~uint64_t(0));
+
+			constexpr auto weighted = make_weighted( );
+			static_assert(weighted.edge_at(weighted.edge_between(0, 1)) == 10);
+			static_assert(weighted.edge_at(weighted.edge_between(1, 2)) == 20);
+			static_assert(weighted.edge_between(2, 1) == weighted.npos);
+			static_assert(weighted.at(2) == 'c');
+
+			// Full graphs refuse more verts and edges instead of writing past their arrays
+			static_graph<int, void, 3, 2> small;
+			for (int i = 0; i < 3; ++i)
+				Assert::AreEqual(size_t(i), small.push(i));
+			Assert::AreEqual(small.npos, small.push(3));
+			Assert::IsTrue(small.link(0, 1));
+			Assert::IsFalse(small.link(0, 1));
+			Assert::IsTrue(small.link(1, 2));
+			Assert::IsFalse(small.link(2, 0));
+			Assert::AreEqual(size_t(2), small.edge_count( ));
+			Assert::AreEqual(uint64_t(0), small.next_mask(2));
+		}
+
+		TEST_METHOD(TestWalks)
+		{
+			using walk_type = walk<int, void>;
+			std::mt19937 rng(35);
+
+			graph<int> g;
+			for (int i = 0; i < 500; ++i)
+				g.push(i);
+			link_random(g, 1200, rng);
+
+			// One context and buffer reused across every call
+			walk_type::context ctx;
+			walk_type::step_vector out, stack_steps;
+			for (int k = 0; k < 20; ++k)
+			{
+				std::vector<const vert<int> *> roots{ &g.at(rng( ) % 500), &g.at(rng( ) % 500) };
+
+				// The recursive and iterative depth-first walks agree step for step
+				walk_type::dfs_stack_f(stack_steps, roots);
+				Assert::IsTrue(walk_type::dfs_f(roots) == stack_steps);
+				walk_type::dfs_stack<walk_type::backward>(stack_steps, roots);
+				Assert::IsTrue(walk_type::dfs_r(roots) == stack_steps);
+
+				walk_type::bfs_into<walk_type::forward>(ctx, roots, out);
+				Assert::IsTrue(walk_type::bfs_f(roots) == out);
+				walk_type::dfs_into<walk_type::forward>(ctx, roots, out);
+				Assert::IsTrue(walk_type::dfs_f(roots) == out);
+				walk_type::dfs_stack_into<walk_type::forward>(ctx, roots, out);
+				Assert::IsTrue(walk_type::dfs_f(roots) == out);
+
+				// The visitors see the same steps
+				walk_type::step_vector visited;
+				auto record = [&visited](edge<int> *e, vert<int> *v) { visited.emplace_back(e, v); };
+				walk_type::bfs_each<walk_type::backward>(ctx, roots, record);
+				Assert::IsTrue(walk_type::bfs_r(roots) == visited);
+				visited.clear( );
+				walk_type::dfs_each<walk_type::backward>(ctx, roots, record);
+				Assert::IsTrue(walk_type::dfs_r(roots) == visited);
+				visited.clear( );
+				walk_type::dfs_stack_each<walk_type::backward>(ctx, roots, record);
+				Assert::IsTrue(walk_type::dfs_r(roots) == visited);
+			}
+
+			// Once grown, the buffer is reused rather than reallocated
+			std::vector<const vert<int> *> root{ &g.at(0) };
+			walk_type::bfs_into<walk_type::forward>(ctx, root, out);
+			const auto *data = out.data( );
+			walk_type::bfs_into<walk_type::forward>(ctx, root, out);
+			Assert::IsTrue(out.data( ) == data);
+
+			// Steps onto payloads divisible by 3 are never taken, whichever walk
+			auto skip_threes = [ ](const edge<int> &, const vert<int> &w) { return static_cast<const int &>(w) % 3 != 0; };
+			auto check_filtered = [&](const walk_type::step_vector &steps)
+			{
+				Assert::IsTrue(steps.size( ) > 1);
+				for (const auto &[e, v] : steps)
+					Assert::IsTrue(e == nullptr || static_cast<const int &>(*v) % 3 != 0);
+			};
+			std::vector<const vert<int> *> start{ &g.at(1) };
+			walk_type::bfs_into<walk_type::forward>(ctx, start, out, skip_threes);
+			check_filtered(out);
+			auto filtered_count = out.size( );
+			walk_type::dfs_into<walk_type::forward>(ctx, start, out, skip_threes);
+			check_filtered(out);
+			Assert::AreEqual(filtered_count, out.size( ));
+			walk_type::dfs_stack_into<walk_type::forward>(ctx, start, out, skip_threes);
+			check_filtered(out);
+			Assert::AreEqual(filtered_count, out.size( ));
+
+			// The same restriction as a view
+			subgraph_view<int, void> view(g, g.find_all([ ](const auto &v) { return static_cast<const int &>(v) % 3 != 0; }));
+			walk_type::bfs_into<walk_type::forward>(ctx, start, out, view.filter( ));
+			Assert::IsTrue(walk_type::bfs_within_f(view, start) == out);
+			Assert::AreEqual(filtered_count, out.size( ));
+		}
 	};
 }